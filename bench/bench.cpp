@@ -0,0 +1,504 @@
+// usync-bench: throughput and acquire latency of the lock policies
+// accepted by usync::synchronized and of the object pools, printed as CSV
+//
+// usync-bench [--threads 1,2,4] [--work 0,16,128] [--reads 0,90,99]
+//             [--duration-ms 200] [--policy name-substring]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#    include <pthread.h>
+#    include <sched.h>
+#elif defined(_WIN32)
+#    include <windows.h>
+#endif
+
+#include <usync/usync.hpp>
+
+
+namespace {
+
+
+    struct options {
+        std::vector<unsigned> threads;
+        std::vector<unsigned> work {0, 16, 128};
+        std::vector<unsigned> reads {0, 90, 99};
+        unsigned duration_ms {200};
+        std::string policy;
+    };
+
+
+    // Critical section touches `work` words of the resource
+    struct resource {
+        std::uint64_t words[256] {};
+    };
+
+
+    struct thread_result {
+        std::uint64_t operations {0};
+        std::uint64_t sink {0};
+        std::vector<std::uint32_t> latencies;
+    };
+
+
+    constexpr std::size_t latencies_capacity = 1 << 20;
+
+
+    // std::mutex has no shared mode, readers take it exclusively
+    template<typename L, typename = void>
+    struct has_shared_mode: std::false_type {};
+
+    template<typename L>
+    struct has_shared_mode<L, std::void_t<decltype(std::declval<L&>().lock_shared())>>
+        : std::true_type {};
+
+
+    std::vector<unsigned> parse_list(char const* text) {
+        std::vector<unsigned> values;
+        char* end = nullptr;
+        for(char const* it = text; *it != '\0'; it = *end == ',' ? end + 1 : end) {
+            values.push_back(unsigned(std::strtoul(it, &end, 10)));
+            if(end == it)
+                break;
+        }
+        return values;
+    }
+
+
+    std::vector<unsigned> default_threads() {
+        auto const cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> values;
+        for(unsigned n = 1; n < cores; n *= 2)
+            values.push_back(n);
+        values.push_back(cores);
+        return values;
+    }
+
+
+    bool parse(int argc, char** argv, options& o) {
+        o.threads = default_threads();
+        for(int i = 1; i + 1 < argc; i += 2) {
+            if(std::strcmp(argv[i], "--threads") == 0)
+                o.threads = parse_list(argv[i + 1]);
+            else if(std::strcmp(argv[i], "--work") == 0)
+                o.work = parse_list(argv[i + 1]);
+            else if(std::strcmp(argv[i], "--reads") == 0)
+                o.reads = parse_list(argv[i + 1]);
+            else if(std::strcmp(argv[i], "--duration-ms") == 0)
+                o.duration_ms = unsigned(std::strtoul(argv[i + 1], nullptr, 10));
+            else if(std::strcmp(argv[i], "--policy") == 0)
+                o.policy = argv[i + 1];
+            else
+                return false;
+        }
+        return (argc % 2) == 1;
+    }
+
+
+    void pin(unsigned index) {
+        auto const cores = std::max(1u, std::thread::hardware_concurrency());
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (index % cores));
+#else
+        (void)cores;
+        (void)index;
+#endif
+    }
+
+
+    std::uint32_t percentile(std::vector<std::uint32_t>& sorted, double p) {
+        if(sorted.empty())
+            return 0;
+        auto const index = std::size_t(p * double(sorted.size() - 1));
+        return sorted[index];
+    }
+
+
+    // Returns the moment the lock was acquired
+    template<typename L, typename S>
+    std::chrono::steady_clock::time_point access(S& shared,
+                                                 bool read,
+                                                 unsigned work,
+                                                 std::uint64_t& sink) {
+        if constexpr(has_shared_mode<L>::value) {
+            if(read) {
+                typename S::shared_access r {shared};
+                auto const acquired = std::chrono::steady_clock::now();
+                for(unsigned i = 0; i != work; ++i)
+                    sink += r->words[i];
+                return acquired;
+            }
+        }
+        typename S::unique_access r {shared};
+        auto const acquired = std::chrono::steady_clock::now();
+        for(unsigned i = 0; i != work; ++i)
+            ++r->words[i];
+        return acquired;
+    }
+
+
+    // Every thread runs operations made by make_operation(thread) for
+    // duration_ms; operation(read, sink) returns the moment its lock was
+    // acquired or, without a lock to wait for, when it completed
+    template<typename MakeOperation>
+    void drive(char const* name,
+               unsigned threads,
+               unsigned work,
+               unsigned reads,
+               unsigned duration_ms,
+               MakeOperation&& make_operation) {
+        using clock = std::chrono::steady_clock;
+
+        std::atomic<bool> started {false};
+        std::atomic<bool> stopped {false};
+        std::vector<thread_result> results(threads);
+        std::vector<std::thread> workers;
+
+        for(unsigned t = 0; t != threads; ++t) {
+            workers.emplace_back([&, t]() {
+                pin(t);
+                auto& result = results[t];
+                result.latencies.reserve(latencies_capacity);
+                std::uint64_t random = 0x9E3779B97F4A7C15ull * (t + 1);
+                auto operation = make_operation(t);
+
+                while(!started.load(std::memory_order_acquire))
+                    usync::relax();
+
+                while(!stopped.load(std::memory_order_relaxed)) {
+                    random ^= random << 13;
+                    random ^= random >> 7;
+                    random ^= random << 17;
+                    bool const read = random % 100 < reads;
+
+                    auto const requested = clock::now();
+                    auto const acquired = operation(read, result.sink);
+
+                    ++result.operations;
+                    if(result.latencies.size() != latencies_capacity) {
+                        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            acquired - requested);
+                        result.latencies.push_back(std::uint32_t(ns.count()));
+                    }
+                }
+            });
+        }
+
+        auto const begin = clock::now();
+        started.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(std::chrono::milliseconds {duration_ms});
+        stopped.store(true, std::memory_order_relaxed);
+        for(auto& worker: workers)
+            worker.join();
+        auto const elapsed = std::chrono::duration<double>(clock::now() - begin).count();
+
+        std::uint64_t operations = 0;
+        std::uint64_t sink = 0;
+        std::vector<std::uint32_t> latencies;
+        for(auto& result: results) {
+            operations += result.operations;
+            sink += result.sink;
+            latencies.insert(latencies.end(),
+                             result.latencies.begin(),
+                             result.latencies.end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::printf("%s,%u,%u,%u,%llu,%.3f,%u,%u,%u\n",
+                    name,
+                    threads,
+                    work,
+                    reads,
+                    static_cast<unsigned long long>(operations),
+                    double(operations) / elapsed / 1e6,
+                    percentile(latencies, 0.5),
+                    percentile(latencies, 0.99),
+                    percentile(latencies, 0.999));
+        std::fflush(stdout);
+        if(sink == 1)   // keeps reads alive
+            std::fputs("", stderr);
+    }
+
+
+    template<typename L>
+    void measure(char const* name,
+                 unsigned threads,
+                 unsigned work,
+                 unsigned reads,
+                 unsigned duration_ms) {
+        usync::synchronized<resource, L> shared;
+        drive(name, threads, work, reads, duration_ms, [&](unsigned) {
+            return [&](bool read, std::uint64_t& sink) {
+                return access<L>(shared, read, work, sink);
+            };
+        });
+    }
+
+
+    bool selected(char const* name, options const& o) {
+        return o.policy.empty() || std::strstr(name, o.policy.c_str()) != nullptr;
+    }
+
+
+    // Writes through synchronized::submit(), latency is until the write
+    // is applied, by this thread or by a combiner
+    template<typename L>
+    void measure_submit(char const* name,
+                        unsigned threads,
+                        unsigned work,
+                        unsigned duration_ms) {
+        usync::synchronized<resource, L> shared;
+        drive(name, threads, work, 0, duration_ms, [&](unsigned) {
+            return [&](bool, std::uint64_t&) {
+                shared.submit([work](resource& r) {
+                    for(unsigned i = 0; i != work; ++i)
+                        ++r.words[i];
+                });
+                return std::chrono::steady_clock::now();
+            };
+        });
+    }
+
+
+    template<typename L> void run_submit(char const* name, options const& o) {
+        if(!selected(name, o))
+            return;
+        for(auto const threads: o.threads)
+            for(auto const work: o.work)
+                measure_submit<L>(name, threads, work, o.duration_ms);
+    }
+
+
+    // Object taken from pool P, `work` words of it touched and recycled;
+    // Source(pool) gives the per-thread view, e.g. a magazine
+    template<typename P, typename Source>
+    void measure_pool(char const* name,
+                      unsigned threads,
+                      unsigned work,
+                      unsigned duration_ms,
+                      P& pool) {
+        drive(name, threads, work, 0, duration_ms, [&](unsigned) {
+            return [&, source = Source(pool)](bool, std::uint64_t& sink) mutable {
+                auto p = source.remake();
+                auto const acquired = std::chrono::steady_clock::now();
+                for(unsigned i = 0; i != work; ++i)
+                    sink += ++p->words[i];
+                source.recycle(p);
+                return acquired;
+            };
+        });
+    }
+
+
+    // Locks the synchronized pool for each remake()/recycle()
+    template<typename T> struct locked_pool {
+        usync::synchronized_pool<T>& shared;
+
+        explicit locked_pool(usync::synchronized_pool<T>& pool) noexcept: shared(pool) {}
+
+        usync::pool_pointer<T> remake() {
+            typename usync::synchronized_pool<T>::unique_access pool {shared};
+            return pool->remake();
+        }
+
+        void recycle(usync::pool_pointer<T> p) {
+            typename usync::synchronized_pool<T>::unique_access pool {shared};
+            pool->recycle(p);
+        }
+    };
+
+
+    // Array of small synchronized counters, thread t only writes element
+    // t, so only sharing of cache lines between neighbours slows it down
+    template<typename L>
+    void measure_adjacent(char const* name, unsigned threads, unsigned duration_ms) {
+        using counter = usync::synchronized<std::uint64_t, L>;
+        std::vector<counter> counters(threads);
+        drive(name, threads, 0, 0, duration_ms, [&](unsigned t) {
+            return [&counters, t](bool, std::uint64_t&) {
+                typename counter::unique_access c {counters[t]};
+                auto const acquired = std::chrono::steady_clock::now();
+                ++*c;
+                return acquired;
+            };
+        });
+    }
+
+
+    template<typename L> void run_adjacent(char const* name, options const& o) {
+        if(!selected(name, o))
+            return;
+        for(auto const threads: o.threads)
+            measure_adjacent<L>(name, threads, o.duration_ms);
+    }
+
+
+    // Threads send writes to owned<resource>, whose owner thread runs
+    // them in process(); post rows measure enqueueing, call rows wait
+    // until the owner has applied the write
+    void measure_owned(char const* name,
+                       unsigned threads,
+                       unsigned work,
+                       unsigned duration_ms,
+                       bool call) {
+        usync::owned<resource> executor {1024};
+        std::atomic<bool> stopped {false};
+        auto owner = std::thread([&]() {
+            pin(threads);
+            while(!stopped.load(std::memory_order_relaxed))
+                if(executor.process() == 0)
+                    std::this_thread::yield();
+            executor.process();
+        });
+
+        auto const write = [work](resource& r) {
+            for(unsigned i = 0; i != work; ++i)
+                ++r.words[i];
+            return r.words[0];
+        };
+        drive(name, threads, work, 0, duration_ms, [&](unsigned) {
+            return [&, done = usync::promise<std::uint64_t> {}](bool, std::uint64_t& sink) mutable {
+                if(call) {
+                    done.clear();
+                    executor.call(done, write);
+                    sink += done.await();
+                } else {
+                    executor.post(write);
+                }
+                return std::chrono::steady_clock::now();
+            };
+        });
+
+        stopped.store(true, std::memory_order_relaxed);
+        owner.join();
+    }
+
+
+    void run_owned(options const& o) {
+        for(auto const threads: o.threads)
+            for(auto const work: o.work) {
+                if(selected("owned/post", o))
+                    measure_owned("owned/post", threads, work, o.duration_ms, false);
+                if(selected("owned/call", o))
+                    measure_owned("owned/call", threads, work, o.duration_ms, true);
+            }
+    }
+
+
+    // Takes every object from lockfree_pool itself
+    template<typename T> struct lockfree_source {
+        usync::lockfree_pool<T>& shared;
+
+        explicit lockfree_source(usync::lockfree_pool<T>& pool) noexcept: shared(pool) {}
+
+        usync::lockfree_pool_pointer<T> remake() { return shared.remake(); }
+        void recycle(usync::lockfree_pool_pointer<T> p) { shared.recycle(p); }
+    };
+
+
+    void run_pools(options const& o) {
+        for(auto const threads: o.threads)
+            for(auto const work: o.work) {
+                if(selected("pool/synchronized", o)) {
+                    usync::synchronized_pool<resource> pool;
+                    measure_pool<usync::synchronized_pool<resource>, locked_pool<resource>>(
+                        "pool/synchronized", threads, work, o.duration_ms, pool);
+                }
+                if(selected("pool/magazine", o)) {
+                    usync::synchronized_pool<resource> pool;
+                    measure_pool<usync::synchronized_pool<resource>,
+                                 usync::pool_magazine<resource>>(
+                        "pool/magazine", threads, work, o.duration_ms, pool);
+                }
+                if(selected("lockfree_pool", o)) {
+                    usync::lockfree_pool<resource> pool {threads * 128};
+                    measure_pool<usync::lockfree_pool<resource>, lockfree_source<resource>>(
+                        "lockfree_pool", threads, work, o.duration_ms, pool);
+                }
+                if(selected("lockfree_pool/magazine", o)) {
+                    usync::lockfree_pool<resource> pool {threads * 128};
+                    measure_pool<usync::lockfree_pool<resource>,
+                                 usync::lockfree_pool_magazine<resource>>(
+                        "lockfree_pool/magazine", threads, work, o.duration_ms, pool);
+                }
+            }
+    }
+
+
+    template<typename L> void run(char const* name, options const& o) {
+        if(!selected(name, o))
+            return;
+        for(auto const threads: o.threads)
+            for(auto const work: o.work)
+                for(auto const reads: o.reads)
+                    measure<L>(name, threads, work, reads, o.duration_ms);
+    }
+
+
+}   // namespace
+
+
+int main(int argc, char** argv) {
+    options o;
+    if(!parse(argc, argv, o)) {
+        std::fprintf(stderr,
+                     "usage: %s [--threads 1,2,4] [--work 0,16,128] [--reads 0,90,99]"
+                     " [--duration-ms 200] [--policy name]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    std::printf("policy,threads,work,read_percent,operations,mops,"
+                "p50_ns,p99_ns,p999_ns\n");
+
+    run<std::mutex>("std::mutex", o);
+    run<usync::padded<std::mutex>>("std::mutex/padded", o);
+    run<std::shared_mutex>("std::shared_mutex", o);
+    run<usync::padded<std::shared_mutex>>("std::shared_mutex/padded", o);
+    run<usync::spinlock>("spinlock", o);
+    run<usync::compact_spinlock>("compact_spinlock", o);
+    run<usync::basic_spinlock<usync::yield_backoff>>("spinlock/yield", o);
+    run<usync::basic_spinlock<usync::pause_backoff>>("spinlock/pause", o);
+    run<usync::basic_spinlock<usync::exponential_backoff<>>>("spinlock/exponential", o);
+    run<usync::basic_spinlock<usync::pause_park_backoff<>>>("spinlock/park", o);
+    run<usync::shared_spinlock>("shared_spinlock", o);
+    run<usync::basic_shared_spinlock<usync::pause_park_backoff<>>>("shared_spinlock/park", o);
+    run<usync::distributed_shared_spinlock<>>("distributed_shared_spinlock", o);
+    run<usync::asymmetric_shared_lock<>>("asymmetric_shared_lock", o);
+    run<usync::ticket_lock>("ticket_lock", o);
+    run<usync::mcs_lock>("mcs_lock", o);
+    run<usync::adaptive_lock>("adaptive_lock", o);
+    run<usync::cohort_lock>("cohort_lock", o);
+    run<usync::seqlock>("seqlock", o);
+    run<usync::elided_lock<>>("elided_lock<spinlock>", o);
+    run<usync::flat_combining<>>("flat_combining", o);
+    run<usync::instrumented<usync::spinlock>>("instrumented<spinlock>", o);
+    run_submit<std::mutex>("std::mutex/submit", o);
+    run_submit<usync::spinlock>("spinlock/submit", o);
+    run_submit<usync::flat_combining<>>("flat_combining/submit", o);
+    run_owned(o);
+    run_adjacent<usync::compact_spinlock>("adjacent/compact_spinlock", o);
+    run_adjacent<usync::padded<usync::compact_spinlock>>("adjacent/padded<compact_spinlock>", o);
+    run_adjacent<usync::spinlock>("adjacent/spinlock", o);
+    run_pools(o);
+
+    return 0;
+}
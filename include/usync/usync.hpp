@@ -6,307 +6,4744 @@
 
 
 #include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <shared_mutex>
+#include <stdexcept>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#    include <coroutine>
+#    define USYNC_HAS_COROUTINES 1
+#endif
+
 #if defined(_MSC_VER)
 #    include <intrin.h>
 #endif
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#    include <cpuid.h>
+#    include <immintrin.h>
+#    define USYNC_RTM_TARGET __attribute__((target("rtm")))
+#elif defined(_MSC_VER) && (defined(_M_AMD64) || defined(_M_IX86))
+#    include <immintrin.h>
+#    define USYNC_RTM_TARGET
+#endif
+
+#if defined(__linux__)
+#    include <climits>
+#    include <linux/futex.h>
+#    include <linux/membarrier.h>
+#    include <sched.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#elif defined(_WIN32)
+// macros are undefined afterwards unless the includer has defined them
+#    if !defined(WIN32_LEAN_AND_MEAN)
+#        define WIN32_LEAN_AND_MEAN
+#        define USYNC_DEFINED_WIN32_LEAN_AND_MEAN
+#    endif
+#    if !defined(NOMINMAX)
+#        define NOMINMAX
+#        define USYNC_DEFINED_NOMINMAX
+#    endif
+#    include <windows.h>
+#    if defined(USYNC_DEFINED_WIN32_LEAN_AND_MEAN)
+#        undef WIN32_LEAN_AND_MEAN
+#        undef USYNC_DEFINED_WIN32_LEAN_AND_MEAN
+#    endif
+#    if defined(USYNC_DEFINED_NOMINMAX)
+#        undef NOMINMAX
+#        undef USYNC_DEFINED_NOMINMAX
+#    endif
+#    if defined(_MSC_VER)
+#        pragma comment(lib, "Synchronization.lib")
+#    endif
+#endif
+
 
 namespace usync {
 
 
+    // Destructive interference size, may be configured with
+    // -DUSYNC_CACHELINE_SIZE=128 when ABI has to be stable across -mtune
+#if defined(USYNC_CACHELINE_SIZE)
+    static constexpr std::size_t cacheline_size = USYNC_CACHELINE_SIZE;
+#elif defined(__cpp_lib_hardware_interference_size)
+#    if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#        pragma GCC diagnostic push
+#        pragma GCC diagnostic ignored "-Winterference-size"
+#    endif
+    static constexpr std::size_t cacheline_size = std::hardware_destructive_interference_size;
+#    if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#        pragma GCC diagnostic pop
+#    endif
+#elif (defined(__APPLE__) && defined(__aarch64__)) || defined(__powerpc64__)
+    static constexpr std::size_t cacheline_size = 128;
+#else
     static constexpr std::size_t cacheline_size = 64;
+#endif
 
 
-    class no_lock {
-    public:
-        no_lock() noexcept = default;
-        no_lock(no_lock const&) noexcept = delete;
-        no_lock& operator=(no_lock const&) noexcept = delete;
+    // Distance between data written by different threads, x86 prefetcher
+    // pulls cache lines in adjacent pairs
+#if defined(__x86_64__) || defined(_M_AMD64) || defined(__i386__) || defined(_M_IX86)
+    static constexpr std::size_t padding_size = 2 * cacheline_size;
+#else
+    static constexpr std::size_t padding_size = cacheline_size;
+#endif
 
-        bool try_lock() noexcept { return true; }
-        void unlock() noexcept {}
-        void lock() noexcept {}
-        bool try_lock_shared() noexcept { return true; }
-        void unlock_shared() noexcept {}
-        void lock_shared() noexcept {}
 
-    };   // no_lock
+    // Value that doesn't share padding_size block with anything else
+    template<typename T>
+    struct alignas(padding_size) cache_padded {
+        T value {};
+
+        T& operator*() noexcept { return value; }
+        T const& operator*() const noexcept { return value; }
+        T* operator->() noexcept { return &value; }
+        T const* operator->() const noexcept { return &value; }
+    };   // cache_padded
+
+
+    // Array of N cache padded values, e.g. per-thread slots
+    template<typename T, std::size_t N>
+    class cache_aligned_array {
+        cache_padded<T> items_[N] {};
+
+        template<typename P, typename R>
+        struct basic_iterator {
+            P* item;
+
+            R& operator*() const noexcept { return item->value; }
+            R* operator->() const noexcept { return &item->value; }
+
+            basic_iterator& operator++() noexcept {
+                ++item;
+                return *this;
+            }
+
+            bool operator==(basic_iterator const& other) const noexcept {
+                return item == other.item;
+            }
 
+            bool operator!=(basic_iterator const& other) const noexcept {
+                return item != other.item;
+            }
+        };
 
-    class spinlock {
     public:
-        spinlock() noexcept = default;
-        spinlock(spinlock const&) noexcept = delete;
-        spinlock& operator=(spinlock const&) noexcept = delete;
 
+        using value_type = T;
+        using iterator = basic_iterator<cache_padded<T>, T>;
+        using const_iterator = basic_iterator<cache_padded<T> const, T const>;
 
-        bool try_lock() noexcept {
-            if(flag_.load(std::memory_order_relaxed))
-                return false;
+        static constexpr std::size_t size() noexcept { return N; }
 
-            return !flag_.exchange(true, std::memory_order_acquire);
-        }
+        T& operator[](std::size_t index) noexcept { return items_[index].value; }
+        T const& operator[](std::size_t index) const noexcept { return items_[index].value; }
 
+        iterator begin() noexcept { return {items_}; }
+        iterator end() noexcept { return {items_ + N}; }
+        const_iterator begin() const noexcept { return {items_}; }
+        const_iterator end() const noexcept { return {items_ + N}; }
+    };   // cache_aligned_array
 
-        void unlock() noexcept {
-            flag_.store(false, std::memory_order_release);
+
+    inline void relax() noexcept {
+#if defined(_MSC_VER)
+
+#    if defined(_M_AMD64) || defined(_M_IX86)
+        _mm_pause();
+#    elif defined(_M_ARM) || defined(_M_ARM64)
+        __yield();
+#    endif   // _M_IX86
+
+#else
+
+#    if defined(__x86_64__) || defined(__i386__)
+        __asm__ __volatile__("pause");
+#    elif defined(__arm__) || defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#    endif   // __i386__
+
+#endif   // _MSC_VER
+    }
+
+
+    namespace detail {
+
+
+        // Blocks while word == expected; spurious wake-ups are allowed
+        inline void futex_wait(std::atomic<std::uint32_t> const& word,
+                               std::uint32_t expected) noexcept {
+#if defined(__linux__)
+            syscall(SYS_futex,
+                    static_cast<void const*>(&word),
+                    FUTEX_WAIT_PRIVATE,
+                    expected,
+                    nullptr,
+                    nullptr,
+                    0);
+#elif defined(_WIN32)
+            WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(&word),
+                          &expected,
+                          sizeof(expected),
+                          INFINITE);
+#else
+            if(word.load(std::memory_order_relaxed) == expected)
+                std::this_thread::yield();
+#endif
         }
 
 
-        void lock() noexcept {
-            while(!try_lock())
+        // Like futex_wait but gives up after timeout
+        inline void futex_wait_for(std::atomic<std::uint32_t> const& word,
+                                   std::uint32_t expected,
+                                   std::chrono::nanoseconds timeout) noexcept {
+            if(timeout <= std::chrono::nanoseconds::zero())
+                return;
+#if defined(__linux__)
+            auto const seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            timespec relative;
+            relative.tv_sec = static_cast<decltype(relative.tv_sec)>(seconds.count());
+            relative.tv_nsec = static_cast<decltype(relative.tv_nsec)>((timeout - seconds).count());
+            syscall(SYS_futex,
+                    static_cast<void const*>(&word),
+                    FUTEX_WAIT_PRIVATE,
+                    expected,
+                    &relative,
+                    nullptr,
+                    0);
+#elif defined(_WIN32)
+            auto const milliseconds =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    timeout + std::chrono::milliseconds {1} - std::chrono::nanoseconds {1});
+            WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(&word),
+                          &expected,
+                          sizeof(expected),
+                          static_cast<DWORD>(milliseconds.count()));
+#else
+            (void)timeout;
+            if(word.load(std::memory_order_relaxed) == expected)
                 std::this_thread::yield();
+#endif
         }
 
 
-        bool try_lock_shared() noexcept { return try_lock(); }
+        inline void futex_wake_one(std::atomic<std::uint32_t>& word) noexcept {
+#if defined(__linux__)
+            syscall(SYS_futex,
+                    static_cast<void*>(&word),
+                    FUTEX_WAKE_PRIVATE,
+                    1,
+                    nullptr,
+                    nullptr,
+                    0);
+#elif defined(_WIN32)
+            WakeByAddressSingle(&word);
+#else
+            (void)word;
+#endif
+        }
 
 
-        void unlock_shared() noexcept { unlock(); }
+        inline void futex_wake_all(std::atomic<std::uint32_t>& word) noexcept {
+#if defined(__linux__)
+            syscall(SYS_futex,
+                    static_cast<void*>(&word),
+                    FUTEX_WAKE_PRIVATE,
+                    INT_MAX,
+                    nullptr,
+                    nullptr,
+                    0);
+#elif defined(_WIN32)
+            WakeByAddressAll(&word);
+#else
+            (void)word;
+#endif
+        }
 
 
-        void lock_shared() noexcept { lock(); }
+        // Words without their own waiter count share parked counters
+        // hashed by address, so that waking is free when nobody sleeps
+        struct parking_bucket {
+            std::atomic<std::uint32_t> parked {0};
+        };
 
 
-    private:
-        alignas(cacheline_size) std::atomic_bool flag_ {false};
+        inline parking_bucket& parking_bucket_of(void const* address) noexcept {
+            static cache_aligned_array<parking_bucket, 16> buckets;
+            auto const key = reinterpret_cast<std::uintptr_t>(address) / cacheline_size;
+            return buckets[key % buckets.size()];
+        }
 
-    };   // spinlock
 
+        inline void park(std::atomic<std::uint32_t> const& word,
+                         std::uint32_t busy) noexcept {
+            auto& bucket = parking_bucket_of(&word);
+            bucket.parked.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(word.load(std::memory_order_relaxed) == busy)
+                futex_wait(word, busy);
+            bucket.parked.fetch_sub(1, std::memory_order_relaxed);
+        }
 
-    class shared_spinlock {
-    public:
-        shared_spinlock() noexcept = default;
-        shared_spinlock(shared_spinlock const&) noexcept = delete;
-        shared_spinlock& operator=(shared_spinlock const&) noexcept = delete;
 
+        // Returns false if deadline is reached while word == busy
+        template<class Clock, class Duration>
+        bool park_until(std::atomic<std::uint32_t> const& word,
+                        std::uint32_t busy,
+                        std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            auto& bucket = parking_bucket_of(&word);
+            bucket.parked.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool done = true;
+            while(word.load(std::memory_order_relaxed) == busy) {
+                auto const now = Clock::now();
+                if(now >= deadline) {
+                    done = false;
+                    break;
+                }
+                futex_wait_for(word,
+                               busy,
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   deadline - now));
+            }
+            bucket.parked.fetch_sub(1, std::memory_order_relaxed);
+            return done;
+        }
 
-        bool try_lock() noexcept {
-            if(data_.writer.load(std::memory_order_relaxed))
-                return false;
 
-            if(data_.writer.exchange(true, std::memory_order_acquire))
-                return false;
+        inline void unpark_one(std::atomic<std::uint32_t>& word) noexcept {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(parking_bucket_of(&word).parked.load(std::memory_order_relaxed) != 0)
+                futex_wake_one(word);
+        }
 
-            while(data_.readers.load(std::memory_order_relaxed) > 0)
-                relax();
 
-            return true;
+        inline void unpark_all(std::atomic<std::uint32_t>& word) noexcept {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(parking_bucket_of(&word).parked.load(std::memory_order_relaxed) != 0)
+                futex_wake_all(word);
         }
 
 
-        void unlock() noexcept {
-            data_.writer.store(false, std::memory_order_release);
+        static constexpr std::size_t default_spins = 256;
+
+
+        // Spins, then parks until word differs from old; returns new value
+        template<std::size_t Spins>
+        std::uint32_t await_change(std::atomic<std::uint32_t> const& word,
+                                   std::uint32_t old) noexcept {
+            for(std::size_t i = 0; i != Spins; ++i) {
+                auto const current = word.load(std::memory_order_acquire);
+                if(current != old)
+                    return current;
+                relax();
+            }
+            for(;;) {
+                auto const current = word.load(std::memory_order_acquire);
+                if(current != old)
+                    return current;
+                park(word, old);
+            }
         }
 
 
-        void lock() noexcept {
-            while(!try_lock())
-                std::this_thread::yield();
+        // Returns false on timeout
+        template<std::size_t Spins, class Clock, class Duration>
+        bool await_change_until(std::atomic<std::uint32_t> const& word,
+                                std::uint32_t old,
+                                std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            for(std::size_t i = 0; i != Spins; ++i) {
+                if(word.load(std::memory_order_acquire) != old)
+                    return true;
+                relax();
+            }
+            for(;;) {
+                if(word.load(std::memory_order_acquire) != old)
+                    return true;
+                if(!park_until(word, old, deadline))
+                    return word.load(std::memory_order_acquire) != old;
+            }
         }
 
 
-        bool try_lock_shared() noexcept {
-            if(data_.writer.load(std::memory_order_relaxed))
-                return false;
+        inline std::size_t countr_zero(std::uint64_t bits) noexcept {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return index;
+#else
+            return static_cast<std::size_t>(__builtin_ctzll(bits));
+#endif
+        }
 
-            data_.readers.fetch_add(1, std::memory_order_relaxed);
 
-            bool expected = true;
-            if(data_.writer.compare_exchange_weak(expected,
-                                                  true,
-                                                  std::memory_order_relaxed)) {
-                data_.readers.fetch_sub(1, std::memory_order_relaxed);
-                return false;
+        // Small indices unique among live threads, reused after thread exit
+        class thread_index_registry {
+        public:
+            static constexpr std::size_t capacity = 1024;
+
+            std::size_t acquire() noexcept {
+                for(auto& word: used_) {
+                    auto bits = word.load(std::memory_order_relaxed);
+                    while(bits != ~std::uint64_t {0}) {
+                        auto const bit = countr_zero(~bits);
+                        // pairs with release(): stores of the previous holder
+                        // of the index, e.g. to reader slots, are visible
+                        if(word.compare_exchange_weak(bits,
+                                                      bits | std::uint64_t {1} << bit,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed))
+                            return std::size_t(&word - used_) * 64 + bit;
+                    }
+                }
+                return capacity + overflow_.fetch_add(1, std::memory_order_relaxed);
             }
 
-            return true;
+
+            void release(std::size_t index) noexcept {
+                if(index >= capacity)
+                    return;
+                used_[index / 64].fetch_and(~(std::uint64_t {1} << index % 64),
+                                            std::memory_order_release);
+            }
+
+        private:
+            std::atomic<std::uint64_t> used_[capacity / 64] {};
+            std::atomic<std::size_t> overflow_ {0};
+        };
+
+
+        inline thread_index_registry& thread_indices() noexcept {
+            static thread_index_registry registry;
+            return registry;
         }
 
 
-        void unlock_shared() noexcept {
-            data_.readers.fetch_sub(1, std::memory_order_relaxed);
+        struct thread_index_holder {
+            std::size_t value {thread_indices().acquire()};
+
+            thread_index_holder() noexcept = default;
+            thread_index_holder(thread_index_holder const&) = delete;
+            thread_index_holder& operator=(thread_index_holder const&) = delete;
+            ~thread_index_holder() { thread_indices().release(value); }
+        };
+
+
+        inline std::size_t this_thread_index() noexcept {
+            thread_local thread_index_holder holder;
+            return holder.value;
         }
 
 
-        void lock_shared() noexcept {
-            while(!try_lock_shared())
-                std::this_thread::yield();
+        // CPU the thread runs on now, thread index where it's unknown
+        inline std::size_t current_cpu() noexcept {
+#if defined(__linux__)
+            auto const cpu = sched_getcpu();
+            if(cpu >= 0)
+                return std::size_t(cpu);
+#elif defined(_WIN32)
+            return std::size_t(GetCurrentProcessorNumber());
+#endif
+            return this_thread_index();
         }
 
-    private:
-        alignas(cacheline_size) struct data {
-            std::atomic_bool writer {false};
-            std::atomic_uint readers {0};
-        } data_;
 
+        inline bool register_process_barrier() noexcept {
+#if defined(__linux__) && defined(__NR_membarrier)
+            auto const commands = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+            if(commands < 0 || (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) == 0)
+                return false;
+            return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#elif defined(_WIN32)
+            return true;
+#else
+            return false;
+#endif
+        }
 
-        static void relax() {
-#if defined(_MSC_VER)
 
-#    if defined(_M_AMD64) || defined(_M_IX86)
-            _mm_pause();
-#    elif defined(_M_ARM)
-            __yield();
-#    endif   // _M_IX86
+        inline bool has_process_barrier() noexcept {
+            static bool const registered = register_process_barrier();
+            return registered;
+        }
 
-#else
 
-#    if defined(__x86_64__) || defined(__i386__)
-            __asm__ __volatile__("pause");
-#    elif defined(__arm__)
-            __asm__ __volatile__("yield");
-#    endif   // __i386__
+        // Side of asymmetric barrier executed often: just a compiler
+        // barrier when the rare side can force barriers on every thread
+        inline void light_barrier() noexcept {
+            if(has_process_barrier())
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            else
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
 
-#endif   // _MSC_VER
+
+        // Side of asymmetric barrier executed rarely: full barrier on every
+        // running thread of the process
+        inline void heavy_barrier() noexcept {
+            if(!has_process_barrier()) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return;
+            }
+#if defined(__linux__) && defined(__NR_membarrier)
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+#elif defined(_WIN32)
+            FlushProcessWriteBuffers();
+#endif
         }
-    };   // shared_spinlock
 
 
-    template<typename T, typename L = spinlock>
-    struct synchronized {
-        using resource_type = T;
+        // NUMA node the thread runs on now, 0 where it's unknown
+        inline std::size_t current_numa_node() noexcept {
+#if defined(__linux__)
+            unsigned cpu = 0, node = 0;
+#    if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)
+            if(getcpu(&cpu, &node) == 0)   // vDSO
+                return node;
+#    elif defined(__NR_getcpu)
+            if(syscall(__NR_getcpu, &cpu, &node, nullptr) == 0)
+                return node;
+#    endif
+            return 0;
+#elif defined(_WIN32)
+            PROCESSOR_NUMBER processor;
+            GetCurrentProcessorNumberEx(&processor);
+            USHORT node = 0;
+            if(!GetNumaProcessorNodeEx(&processor, &node))
+                return 0;
+            return node;
+#else
+            return 0;
+#endif
+        }
 
-        struct unique_access {
-            unique_access() = delete;
-            unique_access(unique_access const&) = delete;
-            unique_access& operator=(unique_access const&) = delete;
 
-            unique_access(synchronized& owner) noexcept
-                : guard_(owner.lock_), resource_(owner.resource_) {}
+        // Cycle counter where it's cheap to read, steady clock elsewhere
+        inline std::uint64_t ticks() noexcept {
+#if defined(_MSC_VER) && (defined(_M_AMD64) || defined(_M_IX86))
+            return __rdtsc();
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+            return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+            std::uint64_t value;
+            asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+            return value;
+#else
+            auto const since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+            return std::uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count());
+#endif
+        }
 
-            T& operator*() const noexcept { return resource_; }
-            T* operator->() const noexcept { return &resource_; }
-            template<typename F> void run(F&& f) { f(resource_); }
+
+        // Reads Clock only when ticks() has moved far enough since the last
+        // reading, so spin loops can check it on every iteration
+        template<class Clock, class Duration> class deadline_timer {
+        public:
+            static constexpr std::uint64_t ticks_per_check = 2048;
+
+            explicit deadline_timer(std::chrono::time_point<Clock, Duration> const& deadline) noexcept
+                : deadline_(deadline), checked_(ticks()) {}
+
+            bool expired() noexcept {
+                auto const now = ticks();
+                if(now - checked_ < ticks_per_check)
+                    return false;
+                checked_ = now;
+                return Clock::now() >= deadline_;
+            }
 
         private:
-            std::unique_lock<L> guard_;
-            T& resource_;
+            std::chrono::time_point<Clock, Duration> deadline_;
+            std::uint64_t checked_;
+        };
 
-        };   // unique_access
 
+        // Calls try_acquire() at least once and until it succeeds or
+        // deadline is reached
+        template<class Clock, class Duration, typename F>
+        bool poll_until(deadline_timer<Clock, Duration>& timer, F&& try_acquire) {
+            for(std::uint32_t polls = 0;; ++polls) {
+                if(try_acquire())
+                    return true;
+                if(timer.expired())
+                    return false;
+                if(polls < default_spins)
+                    relax();
+                else
+                    std::this_thread::yield();
+            }
+        }
 
-        struct shared_access {
-            shared_access() = delete;
-            shared_access(shared_access const&) = delete;
-            shared_access& operator=(shared_access const&) = delete;
 
-            shared_access(synchronized const& owner) noexcept
-                : guard_(owner.lock_), resource_(owner.resource_) {}
+        template<class Clock, class Duration, typename F>
+        bool poll_until(std::chrono::time_point<Clock, Duration> const& deadline,
+                        F&& try_acquire) {
+            deadline_timer<Clock, Duration> timer {deadline};
+            return poll_until(timer, std::forward<F>(try_acquire));
+        }
 
-            T const& operator*() const noexcept { return resource_; }
-            T const* operator->() const noexcept { return &resource_; }
-            template<typename F> void run(F&& f) { f(resource_); }
 
-        private:
-            std::shared_lock<L> guard_;
-            T const& resource_;
+        template<typename L, typename = void> struct has_timed_lock: std::false_type {};
 
-        };   // shared_access
+        template<typename L>
+        struct has_timed_lock<L,
+                              std::void_t<decltype(std::declval<L&>().try_lock_until(
+                                  std::chrono::steady_clock::now()))>>: std::true_type {};
 
 
-        synchronized() = default;
-        synchronized(synchronized const&) = delete;
-        synchronized& operator=(synchronized const&) = delete;
-        synchronized(synchronized&&) = default;
-        synchronized& operator=(synchronized&&) = default;
+        template<typename L, typename = void> struct has_timed_lock_shared: std::false_type {};
 
-        template<typename... Args>
-        synchronized(Args&&... args): resource_(std::forward<Args>(args)...) {}
+        template<typename L>
+        struct has_timed_lock_shared<L,
+                                     std::void_t<decltype(std::declval<L&>().try_lock_shared_until(
+                                         std::chrono::steady_clock::now()))>>: std::true_type {};
 
-    private:
-        mutable L lock_;
-        T resource_;
 
-    };   // synchronized
+        // Timed acquisition for any lock policy, untimed ones are polled
+        template<typename L, class Clock, class Duration>
+        bool try_lock_until(L& lock, std::chrono::time_point<Clock, Duration> const& deadline) {
+            if constexpr(has_timed_lock<L>::value)
+                return lock.try_lock_until(deadline);
+            else
+                return poll_until(deadline, [&]() { return lock.try_lock(); });
+        }
 
 
-    template<typename T>
-    class promise {
-        T value_;
-        std::atomic_flag event_;
+        template<typename L, class Clock, class Duration>
+        bool try_lock_shared_until(L& lock,
+                                   std::chrono::time_point<Clock, Duration> const& deadline) {
+            if constexpr(has_timed_lock_shared<L>::value)
+                return lock.try_lock_shared_until(deadline);
+            else
+                return poll_until(deadline, [&]() { return lock.try_lock_shared(); });
+        }
 
-    public:
 
-        promise() = default;
-        promise(promise const&) = delete;
-        promise& operator = (promise const&) = delete;
+        // Hardware transactions (Intel RTM), detected at run time
+        constexpr unsigned rtm_started = ~0u;
+        constexpr unsigned rtm_explicit_abort = 1u << 0;
+        constexpr unsigned rtm_may_retry = 1u << 1;
 
-        promise& operator = (T const& value) {
-            value_ = value;
-            event_.test_and_set(std::memory_order_relaxed);
-            event_.notify_one();
-            return *this;
+#if defined(USYNC_RTM_TARGET)
+
+        inline bool detect_rtm() noexcept {
+            unsigned ebx = 0, edx = 0;
+#    if defined(_MSC_VER)
+            int registers[4];
+            __cpuid(registers, 0);
+            if(registers[0] < 7)
+                return false;
+            __cpuidex(registers, 7, 0);
+            ebx = unsigned(registers[1]);
+            edx = unsigned(registers[3]);
+#    else
+            unsigned eax = 0, ecx = 0;
+            if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+                return false;
+#    endif
+            // RTM is present and microcode doesn't force it to abort
+            return (ebx >> 11 & 1) != 0 && (edx >> 11 & 1) == 0;
         }
 
 
-        promise& operator = (T&& value) {
-            value_ = std::move(value);
-            event_.test_and_set(std::memory_order_relaxed);
-            event_.notify_one();
-            return *this;
+        inline bool has_rtm() noexcept {
+            static bool const supported = detect_rtm();
+            return supported;
         }
 
 
-        T const& await() const& noexcept {
-            event_.wait(false, std::memory_order_relaxed);
-            return value_;            
+        USYNC_RTM_TARGET inline unsigned rtm_begin() noexcept { return _xbegin(); }
+        USYNC_RTM_TARGET inline void rtm_end() noexcept { _xend(); }
+        USYNC_RTM_TARGET inline void rtm_abort() noexcept { _xabort(0xff); }
+        USYNC_RTM_TARGET inline bool rtm_active() noexcept { return _xtest() != 0; }
+
+#else
+
+        inline bool has_rtm() noexcept { return false; }
+        inline unsigned rtm_begin() noexcept { return 0; }
+        inline void rtm_end() noexcept {}
+        inline void rtm_abort() noexcept {}
+        inline bool rtm_active() noexcept { return false; }
+
+#endif   // USYNC_RTM_TARGET
+
+
+    }   // namespace detail
+
+
+    // Backoff policies are instantiated once per acquisition; wait() is
+    // called after every failed attempt while word holds busy value
+
+    class yield_backoff {
+    public:
+        void wait(std::atomic<std::uint32_t> const&, std::uint32_t) noexcept {
+            std::this_thread::yield();
         }
 
+        static void wake_one(std::atomic<std::uint32_t>&) noexcept {}
+        static void wake_all(std::atomic<std::uint32_t>&) noexcept {}
 
-        T&& await() && noexcept {
-            event_.wait(false, std::memory_order_relaxed);
-            return std::move(value_);
+    };   // yield_backoff
+
+
+    class pause_backoff {
+    public:
+        void wait(std::atomic<std::uint32_t> const&, std::uint32_t) noexcept {
+            relax();
         }
 
+        static void wake_one(std::atomic<std::uint32_t>&) noexcept {}
+        static void wake_all(std::atomic<std::uint32_t>&) noexcept {}
 
-        void clear() {
-            event_.clear(std::memory_order_relaxed);
+    };   // pause_backoff
+
+
+    template<std::size_t Limit = 64>
+    class exponential_backoff {
+    public:
+        static_assert(Limit > 0);
+
+        void wait(std::atomic<std::uint32_t> const&, std::uint32_t) noexcept {
+            for(std::size_t i = 0; i != pauses_; ++i)
+                relax();
+            if(pauses_ < Limit)
+                pauses_ = pauses_ * 2 < Limit ? pauses_ * 2 : Limit;
         }
 
-    }; // promise
+        static void wake_one(std::atomic<std::uint32_t>&) noexcept {}
+        static void wake_all(std::atomic<std::uint32_t>&) noexcept {}
 
+    private:
+        std::size_t pauses_ {1};
 
-    template<class T> class pool {
+    };   // exponential_backoff
 
-        std::vector<T> recycled_;
-        std::list<T> in_use_;
 
+    template<std::size_t Spins = 64>
+    class pause_yield_backoff {
     public:
+        void wait(std::atomic<std::uint32_t> const&, std::uint32_t) noexcept {
+            if(spins_ == Spins) {
+                std::this_thread::yield();
+                return;
+            }
+            ++spins_;
+            relax();
+        }
 
-        using pointer = typename std::list<T>::iterator;
+        static void wake_one(std::atomic<std::uint32_t>&) noexcept {}
+        static void wake_all(std::atomic<std::uint32_t>&) noexcept {}
 
-        pool() = default;
-        pool(pool const&) = delete;
-        pool& operator = (pool const&) = delete;
-        pool(pool&&) = default;
-        pool& operator = (pool&&) = default;
+    private:
+        std::size_t spins_ {0};
 
-        pointer remake() {
-            if(recycled_.empty()) {
-                in_use_.push_front(T{});
-            } else {
-                in_use_.push_front(std::move(recycled_.back()));
-                recycled_.pop_back();
+    };   // pause_yield_backoff
+
+
+    template<std::size_t Spins = 64>
+    class pause_park_backoff {
+    public:
+        void wait(std::atomic<std::uint32_t> const& word,
+                  std::uint32_t busy) noexcept {
+            if(spins_ == Spins) {
+                detail::park(word, busy);
+                return;
             }
-            return in_use_.begin();
+            ++spins_;
+            relax();
         }
 
+        static void wake_one(std::atomic<std::uint32_t>& word) noexcept {
+            detail::unpark_one(word);
+        }
 
-        void recycle(pointer it) {
-            recycled_.push_back(std::move(*it));
-            in_use_.erase(it);
+        static void wake_all(std::atomic<std::uint32_t>& word) noexcept {
+            detail::unpark_all(word);
         }
 
-    }; // pool
+    private:
+        std::size_t spins_ {0};
 
-    template<class T> using pool_pointer = typename pool<T>::pointer;
-    template<class T> using synchronized_pool = synchronized<pool<T>>;
+    };   // pause_park_backoff
+
+
+    class no_lock {
+    public:
+        no_lock() noexcept = default;
+        no_lock(no_lock const&) noexcept = delete;
+        no_lock& operator=(no_lock const&) noexcept = delete;
+
+        bool try_lock() noexcept { return true; }
+        void unlock() noexcept {}
+        void lock() noexcept {}
+        bool try_lock_shared() noexcept { return true; }
+        void unlock_shared() noexcept {}
+        void lock_shared() noexcept {}
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const&) noexcept { return true; }
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const&) noexcept { return true; }
+
+        template<class Rep, class Period>
+        bool try_lock_shared_for(std::chrono::duration<Rep, Period> const&) noexcept { return true; }
+
+        template<class Clock, class Duration>
+        bool try_lock_shared_until(std::chrono::time_point<Clock, Duration> const&) noexcept {
+            return true;
+        }
+
+    };   // no_lock
+
+
+    // Flag is aligned to Align, cache line by default so the resource
+    // declared next doesn't share line with spinners
+    template<typename B = pause_yield_backoff<>, std::size_t Align = cacheline_size>
+    class basic_spinlock {
+    public:
+        using backoff_type = B;
+
+        basic_spinlock() noexcept = default;
+        basic_spinlock(basic_spinlock const&) noexcept = delete;
+        basic_spinlock& operator=(basic_spinlock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(flag_.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            return flag_.exchange(1, std::memory_order_acquire) == 0;
+        }
+
+
+        void unlock() noexcept {
+            flag_.store(0, std::memory_order_release);
+            B::wake_one(flag_);
+        }
+
+
+        void lock() noexcept {
+            B backoff;
+            while(!try_lock())
+                backoff.wait(flag_, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        bool is_locked() const noexcept { return flag_.load(std::memory_order_relaxed) != 0; }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+    private:
+        alignas(Align) std::atomic<std::uint32_t> flag_ {0};
+
+    };   // basic_spinlock
+
+
+    template<typename B = pause_yield_backoff<>>
+    class basic_shared_spinlock {
+    public:
+        using backoff_type = B;
+
+        basic_shared_spinlock() noexcept = default;
+        basic_shared_spinlock(basic_shared_spinlock const&) noexcept = delete;
+        basic_shared_spinlock& operator=(basic_shared_spinlock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(!try_lock_writer())
+                return false;
+
+            // readers arriving from now on back off, so writers never starve
+            while(data_.readers.load(std::memory_order_seq_cst) > 0)
+                relax();
+
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            data_.writer.store(0, std::memory_order_release);
+            B::wake_all(data_.writer);
+        }
+
+
+        void lock() noexcept {
+            B backoff;
+            while(!try_lock())
+                backoff.wait(data_.writer, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        // Gives up the writer flag if readers don't leave before deadline
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            detail::deadline_timer<Clock, Duration> timer {deadline};
+            if(!detail::poll_until(timer, [this]() { return try_lock_writer(); }))
+                return false;
+
+            while(data_.readers.load(std::memory_order_seq_cst) > 0) {
+                if(timer.expired()) {
+                    unlock();
+                    return false;
+                }
+                relax();
+            }
+
+            return true;
+        }
+
+
+        bool try_lock_shared() noexcept {
+            if(data_.writer.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            data_.readers.fetch_add(1, std::memory_order_seq_cst);
+
+            if(data_.writer.load(std::memory_order_seq_cst) != 0) {
+                data_.readers.fetch_sub(1, std::memory_order_release);
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock_shared() noexcept {
+            data_.readers.fetch_sub(1, std::memory_order_release);
+        }
+
+
+        void lock_shared() noexcept {
+            B backoff;
+            while(!try_lock_shared())
+                backoff.wait(data_.writer, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_shared_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_shared_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_shared_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock_shared(); });
+        }
+
+
+        // Upgradable ownership is shared with readers but not with writers
+        // and other upgradable owners, it can become exclusive atomically
+        bool try_lock_upgrade() noexcept {
+            if(data_.upgrader.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            if(data_.upgrader.exchange(1, std::memory_order_seq_cst) != 0)
+                return false;
+
+            if(!try_lock_shared()) {
+                unlock_upgrade_only();
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock_upgrade() noexcept {
+            unlock_shared();
+            unlock_upgrade_only();
+        }
+
+
+        void lock_upgrade() noexcept {
+            B backoff;
+            while(!try_lock_upgrade()) {
+                if(data_.writer.load(std::memory_order_relaxed) != 0)
+                    backoff.wait(data_.writer, 1);
+                else
+                    backoff.wait(data_.upgrader, 1);
+            }
+        }
+
+
+        // Upgradable ownership becomes exclusive once the readers leave
+        void upgrade() noexcept {
+            std::uint32_t expected = 0;
+            // writers set the flag only for a moment when upgrader is present
+            while(!data_.writer.compare_exchange_weak(expected,
+                                                      1,
+                                                      std::memory_order_seq_cst)) {
+                expected = 0;
+                relax();
+            }
+
+            while(data_.readers.load(std::memory_order_seq_cst) > 1)
+                relax();
+
+            data_.readers.fetch_sub(1, std::memory_order_relaxed);
+            unlock_upgrade_only();
+        }
+
+
+        // Fails while there are other readers
+        bool try_upgrade() noexcept {
+            std::uint32_t expected = 0;
+            if(!data_.writer.compare_exchange_strong(expected,
+                                                     1,
+                                                     std::memory_order_seq_cst))
+                return false;
+
+            if(data_.readers.load(std::memory_order_seq_cst) > 1) {
+                unlock();
+                return false;
+            }
+
+            data_.readers.fetch_sub(1, std::memory_order_relaxed);
+            unlock_upgrade_only();
+            return true;
+        }
+
+    private:
+        alignas(cacheline_size) struct data {
+            std::atomic<std::uint32_t> writer {0};
+            std::atomic_uint readers {0};
+            std::atomic<std::uint32_t> upgrader {0};
+        } data_;
+
+
+        bool try_lock_writer() noexcept {
+            if(data_.writer.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            if(data_.writer.exchange(1, std::memory_order_seq_cst) != 0)
+                return false;
+
+            // upgradable owner is going to become writer itself
+            if(data_.upgrader.load(std::memory_order_seq_cst) != 0) {
+                unlock();
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock_upgrade_only() noexcept {
+            data_.upgrader.store(0, std::memory_order_release);
+            B::wake_all(data_.upgrader);
+        }
+
+    };   // basic_shared_spinlock
+
+
+    using spinlock = basic_spinlock<>;
+    using shared_spinlock = basic_shared_spinlock<>;
+
+    // Shares cache line with small resource, so the owner touches one line;
+    // pays off when lock is rarely contended
+    using compact_spinlock = basic_spinlock<pause_yield_backoff<>, alignof(std::uint32_t)>;
+
+
+    // Places any lock policy on its own cache lines, e.g. std::mutex,
+    // so the resource next to it isn't invalidated by waiters
+    template<typename L>
+    struct alignas(cacheline_size) padded: L {
+        using lock_type = L;
+        using L::L;
+    };   // padded
+
+
+    enum class rw_preference { writers, readers };
+
+
+    // Readers count themselves in per-thread slots on separate cache lines,
+    // writers scan all the slots. With rw_preference::writers a pending
+    // writer stops new readers, with rw_preference::readers it waits for
+    // a moment without readers instead
+    template<std::size_t Slots = 32,
+             rw_preference P = rw_preference::writers,
+             typename B = pause_yield_backoff<>>
+    class distributed_shared_spinlock {
+    public:
+        static_assert(Slots > 0);
+
+        using backoff_type = B;
+
+        distributed_shared_spinlock() noexcept = default;
+        distributed_shared_spinlock(distributed_shared_spinlock const&) noexcept = delete;
+        distributed_shared_spinlock& operator=(distributed_shared_spinlock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(writer_.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            if constexpr(P == rw_preference::readers) {
+                if(has_readers())
+                    return false;
+            }
+
+            if(writer_.exchange(1, std::memory_order_seq_cst) != 0)
+                return false;
+
+            if constexpr(P == rw_preference::readers) {
+                if(has_readers()) {
+                    unlock();
+                    return false;
+                }
+            } else {
+                while(has_readers())
+                    relax();
+            }
+
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            writer_.store(0, std::memory_order_release);
+            B::wake_all(writer_);
+        }
+
+
+        void lock() noexcept {
+            B backoff;
+            while(!try_lock())
+                backoff.wait(writer_, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            if constexpr(P == rw_preference::readers) {
+                return detail::poll_until(deadline, [this]() { return try_lock(); });
+            } else {
+                detail::deadline_timer<Clock, Duration> timer {deadline};
+                auto const acquired = detail::poll_until(timer, [this]() {
+                    return writer_.load(std::memory_order_relaxed) == 0
+                        && writer_.exchange(1, std::memory_order_seq_cst) == 0;
+                });
+                if(!acquired)
+                    return false;
+
+                while(has_readers()) {
+                    if(timer.expired()) {
+                        unlock();
+                        return false;
+                    }
+                    relax();
+                }
+
+                return true;
+            }
+        }
+
+
+        bool try_lock_shared() noexcept {
+            auto& readers = this_thread_readers();
+            readers.fetch_add(1, std::memory_order_seq_cst);
+
+            if(writer_.load(std::memory_order_seq_cst) != 0) {
+                readers.fetch_sub(1, std::memory_order_release);
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock_shared() noexcept {
+            this_thread_readers().fetch_sub(1, std::memory_order_release);
+        }
+
+
+        void lock_shared() noexcept {
+            B backoff;
+            while(!try_lock_shared())
+                backoff.wait(writer_, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_shared_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_shared_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_shared_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock_shared(); });
+        }
+
+    private:
+        struct slot {
+            std::atomic<std::uint32_t> readers {0};
+        };
+
+        alignas(cacheline_size) std::atomic<std::uint32_t> writer_ {0};
+        cache_aligned_array<slot, Slots> slots_;
+
+
+        std::atomic<std::uint32_t>& this_thread_readers() noexcept {
+            return slots_[detail::this_thread_index() % Slots].readers;
+        }
+
+
+        bool has_readers() const noexcept {
+            for(auto const& slot: slots_)
+                if(slot.readers.load(std::memory_order_seq_cst) != 0)
+                    return true;
+            return false;
+        }
+
+    };   // distributed_shared_spinlock
+
+
+    // Readers of the first Slots threads only store to their own slot and
+    // put compiler barrier, writer makes it work with membarrier() on Linux
+    // or FlushProcessWriteBuffers() on Windows, i.e. a barrier on every
+    // running thread of the process. Other threads and systems without
+    // such barrier pay for seq_cst fences. Writers are preferred
+    template<std::size_t Slots = 64, typename B = pause_yield_backoff<>>
+    class asymmetric_shared_lock {
+    public:
+        static_assert(Slots > 0);
+
+        using backoff_type = B;
+
+        asymmetric_shared_lock() noexcept { detail::has_process_barrier(); }
+        asymmetric_shared_lock(asymmetric_shared_lock const&) noexcept = delete;
+        asymmetric_shared_lock& operator=(asymmetric_shared_lock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(writer_.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            if(writer_.exchange(1, std::memory_order_seq_cst) != 0)
+                return false;
+
+            detail::heavy_barrier();
+            if(has_readers()) {
+                unlock();
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            writer_.store(0, std::memory_order_release);
+            B::wake_all(writer_);
+        }
+
+
+        void lock() noexcept {
+            B backoff;
+            while(writer_.exchange(1, std::memory_order_seq_cst) != 0)
+                backoff.wait(writer_, 1);
+
+            detail::heavy_barrier();
+            while(has_readers())
+                relax();
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            detail::deadline_timer<Clock, Duration> timer {deadline};
+            auto const acquired = detail::poll_until(timer, [this]() {
+                return writer_.load(std::memory_order_relaxed) == 0
+                    && writer_.exchange(1, std::memory_order_seq_cst) == 0;
+            });
+            if(!acquired)
+                return false;
+
+            detail::heavy_barrier();
+            while(has_readers()) {
+                if(timer.expired()) {
+                    unlock();
+                    return false;
+                }
+                relax();
+            }
+
+            return true;
+        }
+
+
+        bool try_lock_shared() noexcept {
+            auto const index = detail::this_thread_index();
+            if(index >= Slots)
+                return try_lock_overflow();
+
+            auto& readers = slots_[index].readers;
+            // no other thread stores to the slot, thread_index_registry
+            // orders the stores of its previous thread before ours
+            readers.store(readers.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+            detail::light_barrier();
+
+            if(writer_.load(std::memory_order_acquire) != 0) {
+                readers.store(readers.load(std::memory_order_relaxed) - 1,
+                              std::memory_order_release);
+                return false;
+            }
+
+            return true;
+        }
+
+
+        void unlock_shared() noexcept {
+            auto const index = detail::this_thread_index();
+            if(index >= Slots) {
+                overflow_.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+
+            auto& readers = slots_[index].readers;
+            readers.store(readers.load(std::memory_order_relaxed) - 1,
+                          std::memory_order_release);
+        }
+
+
+        void lock_shared() noexcept {
+            B backoff;
+            while(!try_lock_shared())
+                backoff.wait(writer_, 1);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_shared_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_shared_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_shared_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock_shared(); });
+        }
+
+    private:
+        struct slot {
+            std::atomic<std::uint32_t> readers {0};
+        };
+
+        alignas(cacheline_size) std::atomic<std::uint32_t> writer_ {0};
+        alignas(cacheline_size) std::atomic<std::uint32_t> overflow_ {0};
+        cache_aligned_array<slot, Slots> slots_;
+
+
+        bool try_lock_overflow() noexcept {
+            overflow_.fetch_add(1, std::memory_order_seq_cst);
+
+            if(writer_.load(std::memory_order_seq_cst) != 0) {
+                overflow_.fetch_sub(1, std::memory_order_release);
+                return false;
+            }
+
+            return true;
+        }
+
+
+        bool has_readers() const noexcept {
+            if(overflow_.load(std::memory_order_seq_cst) != 0)
+                return true;
+            for(auto const& slot: slots_)
+                if(slot.readers.load(std::memory_order_acquire) != 0)
+                    return true;
+            return false;
+        }
+
+    };   // asymmetric_shared_lock
+
+
+    // FIFO lock, waiters back off in proportion to their queue position
+    class ticket_lock {
+    public:
+        ticket_lock() noexcept = default;
+        ticket_lock(ticket_lock const&) noexcept = delete;
+        ticket_lock& operator=(ticket_lock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            auto ticket = serving_.load(std::memory_order_acquire);
+            return next_.compare_exchange_strong(ticket,
+                                                 ticket + 1,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_relaxed);
+        }
+
+
+        void unlock() noexcept {
+            auto const current = serving_.load(std::memory_order_relaxed);
+            serving_.store(current + 1, std::memory_order_release);
+        }
+
+
+        void lock() noexcept {
+            auto const ticket = next_.fetch_add(1, std::memory_order_relaxed);
+            for(;;) {
+                auto const current = serving_.load(std::memory_order_acquire);
+                if(current == ticket)
+                    return;
+                auto const ahead = ticket - current;
+                for(std::uint32_t i = 0; i != ahead * pauses_per_waiter; ++i)
+                    relax();
+            }
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        // Some ticket taken isn't served yet
+        bool is_locked() const noexcept {
+            return next_.load(std::memory_order_relaxed) != serving_.load(std::memory_order_relaxed);
+        }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+    private:
+        static constexpr std::uint32_t pauses_per_waiter = 8;
+
+        alignas(cacheline_size) std::atomic<std::uint32_t> next_ {0};
+        alignas(cacheline_size) std::atomic<std::uint32_t> serving_ {0};
+
+    };   // ticket_lock
+
+
+    namespace detail {
+
+
+        struct mcs_node {
+            alignas(cacheline_size) std::atomic<mcs_node*> next {nullptr};
+            std::atomic<std::uint32_t> locked {0};
+        };
+
+
+        // Queue nodes of the current thread, one per queue lock held
+        class mcs_nodes {
+        public:
+            static constexpr std::size_t capacity = 16;
+
+            mcs_node* acquire() noexcept {
+                if(free_ == 0)
+                    std::terminate();   // too many queue locks held at once
+                std::size_t index = 0;
+                while((free_ & (1u << index)) == 0)
+                    ++index;
+                free_ &= ~(1u << index);
+                return &nodes_[index];
+            }
+
+
+            void release(mcs_node* node) noexcept {
+                free_ |= 1u << (node - nodes_);
+            }
+
+        private:
+            mcs_node nodes_[capacity];
+            std::uint32_t free_ {(1u << capacity) - 1};
+        };
+
+
+        inline mcs_nodes& this_thread_mcs_nodes() noexcept {
+            thread_local mcs_nodes nodes;
+            return nodes;
+        }
+
+
+    }   // namespace detail
+
+
+    // FIFO queue lock, every waiter spins on its own cache line
+    template<typename B = pause_yield_backoff<>>
+    class basic_mcs_lock {
+    public:
+        using backoff_type = B;
+
+        basic_mcs_lock() noexcept = default;
+        basic_mcs_lock(basic_mcs_lock const&) noexcept = delete;
+        basic_mcs_lock& operator=(basic_mcs_lock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(tail_.load(std::memory_order_relaxed) != nullptr)
+                return false;
+
+            auto& nodes = detail::this_thread_mcs_nodes();
+            auto* node = nodes.acquire();
+            node->next.store(nullptr, std::memory_order_relaxed);
+
+            detail::mcs_node* expected = nullptr;
+            if(!tail_.compare_exchange_strong(expected,
+                                              node,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                nodes.release(node);
+                return false;
+            }
+
+            owner_ = node;
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            auto* node = owner_;
+            auto* successor = node->next.load(std::memory_order_acquire);
+            if(successor == nullptr) {
+                auto* expected = node;
+                if(tail_.compare_exchange_strong(expected,
+                                                 nullptr,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+                    detail::this_thread_mcs_nodes().release(node);
+                    return;
+                }
+                // successor has swapped the tail but not linked itself yet
+                while((successor = node->next.load(std::memory_order_acquire))
+                      == nullptr)
+                    relax();
+            }
+
+            successor->locked.store(0, std::memory_order_release);
+            B::wake_one(successor->locked);
+            detail::this_thread_mcs_nodes().release(node);
+        }
+
+
+        void lock() noexcept {
+            auto* node = detail::this_thread_mcs_nodes().acquire();
+            node->next.store(nullptr, std::memory_order_relaxed);
+            node->locked.store(1, std::memory_order_relaxed);
+
+            auto* predecessor = tail_.exchange(node, std::memory_order_acq_rel);
+            if(predecessor != nullptr) {
+                predecessor->next.store(node, std::memory_order_release);
+                B backoff;
+                while(node->locked.load(std::memory_order_acquire) != 0)
+                    backoff.wait(node->locked, 1);
+            }
+
+            owner_ = node;
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        // Queue has an owner, maybe with waiters behind it
+        bool is_locked() const noexcept { return tail_.load(std::memory_order_relaxed) != nullptr; }
+
+
+        // Owner only: some thread is queued behind it
+        bool has_waiters() const noexcept { return tail_.load(std::memory_order_relaxed) != owner_; }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+    private:
+        alignas(cacheline_size) std::atomic<detail::mcs_node*> tail_ {nullptr};
+        detail::mcs_node* owner_ {nullptr};
+
+    };   // basic_mcs_lock
+
+
+    using mcs_lock = basic_mcs_lock<>;
+
+
+    // Global backoff spinlock and MCS lock per NUMA node (C-BO-MCS): while
+    // threads of the owner's node wait, the global lock isn't released and
+    // ownership passes inside the node, up to Passes times in a row
+    template<std::size_t Nodes = 4,
+             std::uint32_t Passes = 64,
+             typename B = pause_yield_backoff<>>
+    class basic_cohort_lock {
+    public:
+        static_assert(Nodes > 0);
+
+        using backoff_type = B;
+
+        basic_cohort_lock() noexcept = default;
+        basic_cohort_lock(basic_cohort_lock const&) noexcept = delete;
+        basic_cohort_lock& operator=(basic_cohort_lock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            auto const node = detail::current_numa_node() % Nodes;
+            auto& c = cohorts_[node];
+            if(!c.lock.try_lock())
+                return false;
+
+            if(!c.global_owned) {
+                if(!global_.try_lock()) {
+                    c.lock.unlock();
+                    return false;
+                }
+                c.global_owned = true;
+            }
+
+            owner_ = node;
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            auto& c = cohorts_[owner_];
+            if(c.passes < Passes && c.lock.has_waiters()) {
+                ++c.passes;
+                c.lock.unlock();
+                return;
+            }
+
+            c.passes = 0;
+            c.global_owned = false;
+            global_.unlock();
+            c.lock.unlock();
+        }
+
+
+        void lock() noexcept {
+            auto const node = detail::current_numa_node() % Nodes;
+            auto& c = cohorts_[node];
+            c.lock.lock();
+            if(!c.global_owned) {
+                global_.lock();
+                c.global_owned = true;
+            }
+            owner_ = node;
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        // Some node holds the global lock, passing it within the node
+        // doesn't release it
+        bool is_locked() const noexcept { return global_.is_locked(); }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+    private:
+        // fields besides lock are guarded by it
+        struct cohort {
+            basic_mcs_lock<B> lock;
+            bool global_owned {false};
+            std::uint32_t passes {0};
+        };
+
+        basic_spinlock<exponential_backoff<>> global_;
+        std::size_t owner_ {0};
+        cache_aligned_array<cohort, Nodes> cohorts_;
+
+    };   // basic_cohort_lock
+
+
+    using cohort_lock = basic_cohort_lock<>;
+
+
+    // Spins for a budget that follows recently observed waiting times,
+    // then parks; unlock() makes a syscall only when someone is parked
+    class adaptive_lock {
+    public:
+        adaptive_lock() noexcept = default;
+        adaptive_lock(adaptive_lock const&) noexcept = delete;
+        adaptive_lock& operator=(adaptive_lock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(state_.load(std::memory_order_relaxed) != 0)
+                return false;
+
+            return state_.exchange(1, std::memory_order_acquire) == 0;
+        }
+
+
+        void unlock() noexcept {
+            state_.store(0, std::memory_order_seq_cst);
+            if(waiters_.load(std::memory_order_seq_cst) != 0)
+                detail::futex_wake_one(state_);
+        }
+
+
+        void lock() noexcept {
+            if(try_lock())
+                return;
+
+            auto const budget = spin_budget_.load(std::memory_order_relaxed);
+            for(std::uint32_t spins = 1; spins <= 2 * budget; ++spins) {
+                relax();
+                if(try_lock()) {
+                    // aim at twice the spinning it took to acquire
+                    adapt(budget, 2 * spins);
+                    return;
+                }
+            }
+            adapt(budget, min_spins);
+
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            while(state_.exchange(1, std::memory_order_seq_cst) != 0)
+                detail::futex_wait(state_, 1);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        bool is_locked() const noexcept { return state_.load(std::memory_order_relaxed) != 0; }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+    private:
+        static constexpr std::uint32_t min_spins = 16;
+        static constexpr std::uint32_t max_spins = 4096;
+
+        alignas(cacheline_size) std::atomic<std::uint32_t> state_ {0};
+        std::atomic<std::uint32_t> waiters_ {0};
+        std::atomic<std::uint32_t> spin_budget_ {100};
+
+
+        void adapt(std::uint32_t budget, std::uint32_t target) noexcept {
+            auto const next = std::int64_t(budget) + (std::int64_t(target) - std::int64_t(budget)) / 8;
+            auto const bounded = next < min_spins ? min_spins : next > max_spins ? max_spins : next;
+            spin_budget_.store(std::uint32_t(bounded), std::memory_order_relaxed);
+        }
+
+    };   // adaptive_lock
+
+
+    // Writers are exclusive and bump the sequence, readers of trivially
+    // copyable resources validate the sequence instead of locking
+    // (see synchronized::optimistic_access); shared locking is exclusive
+    template<typename B = pause_yield_backoff<>>
+    class basic_seqlock {
+    public:
+        using backoff_type = B;
+
+        basic_seqlock() noexcept = default;
+        basic_seqlock(basic_seqlock const&) noexcept = delete;
+        basic_seqlock& operator=(basic_seqlock const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            auto sequence = sequence_.load(std::memory_order_relaxed);
+            if((sequence & 1) != 0)
+                return false;
+
+            if(!sequence_.compare_exchange_strong(sequence,
+                                                  sequence + 1,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed))
+                return false;
+
+            // odd sequence becomes visible before any write to the resource
+            std::atomic_thread_fence(std::memory_order_release);
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            auto const sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1, std::memory_order_release);
+            B::wake_all(sequence_);
+        }
+
+
+        void lock() noexcept {
+            B backoff;
+            while(!try_lock())
+                backoff.wait(sequence_, sequence_.load(std::memory_order_relaxed));
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+        std::uint32_t read_begin() const noexcept {
+            B backoff;
+            for(;;) {
+                auto const sequence = sequence_.load(std::memory_order_acquire);
+                if((sequence & 1) == 0)
+                    return sequence;
+                backoff.wait(sequence_, sequence);
+            }
+        }
+
+
+        bool read_retry(std::uint32_t sequence) const noexcept {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return sequence_.load(std::memory_order_relaxed) != sequence;
+        }
+
+
+    private:
+        alignas(cacheline_size) std::atomic<std::uint32_t> sequence_ {0};
+
+    };   // basic_seqlock
+
+
+    using seqlock = basic_seqlock<>;
+
+
+    // Runs critical section as hardware transaction that only reads lock
+    // word of L, so sections touching disjoint data don't serialize; takes
+    // L after Retries aborts or when CPU has no transactional memory.
+    // Shared ownership is elided the same way as exclusive one. L provides
+    // is_locked(): a racy relaxed read of its lock word, which puts the
+    // word into the read set, so whoever takes L aborts the transaction
+    template<typename L = spinlock, unsigned Retries = 3>
+    class elided_lock {
+    public:
+        using lock_type = L;
+
+        elided_lock() noexcept = default;
+        elided_lock(elided_lock const&) noexcept = delete;
+        elided_lock& operator=(elided_lock const&) noexcept = delete;
+
+        static bool supported() noexcept { return detail::has_rtm(); }
+
+
+        bool try_lock() noexcept {
+            if(supported() && !lock_.is_locked() && try_elide())
+                return true;
+            return lock_.try_lock();
+        }
+
+
+        void unlock() noexcept {
+            // open transaction may be of another elided lock when this
+            // one was taken in fallback and they are released out of order
+            if(supported() && detail::rtm_active() && !lock_.is_locked())
+                detail::rtm_end();
+            else
+                lock_.unlock();
+        }
+
+
+        void lock() noexcept {
+            if(supported()) {
+                for(unsigned attempt = 0; attempt != Retries; ++attempt) {
+                    // don't abort on the fallback owner over and over
+                    while(lock_.is_locked())
+                        relax();
+                    auto const status = detail::rtm_begin();
+                    if(status == detail::rtm_started) {
+                        if(!lock_.is_locked())
+                            return;
+                        detail::rtm_abort();
+                    }
+                    if((status & (detail::rtm_may_retry | detail::rtm_explicit_abort)) == 0)
+                        break;
+                }
+            }
+            lock_.lock();
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) noexcept {
+            return detail::poll_until(deadline, [this]() { return try_lock(); });
+        }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+        bool is_locked() const noexcept { return lock_.is_locked(); }
+
+    private:
+        L lock_;
+
+
+        bool try_elide() noexcept {
+            if(detail::rtm_begin() != detail::rtm_started)
+                return false;
+            // lock word is in read set now, its owner aborts us
+            if(!lock_.is_locked())
+                return true;
+            detail::rtm_abort();
+            return false;
+        }
+
+    };   // elided_lock
+
+
+    // Lock with publication slots: synchronized::submit() posts operation
+    // to the slot of the thread, and whoever takes L applies all posted
+    // operations in one batch while the resource is in its cache
+    template<typename L = spinlock, std::size_t Slots = 32>
+    class flat_combining {
+    public:
+        using lock_type = L;
+
+        flat_combining() noexcept = default;
+        flat_combining(flat_combining const&) noexcept = delete;
+        flat_combining& operator=(flat_combining const&) noexcept = delete;
+
+
+        bool try_lock() noexcept { return lock_.try_lock(); }
+
+
+        void unlock() noexcept { lock_.unlock(); }
+
+
+        void lock() noexcept { lock_.lock(); }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) {
+            return detail::try_lock_until(lock_, deadline);
+        }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() noexcept { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+
+        // Returns when f(resource) is applied by this or combining thread,
+        // rethrows exception of f
+        template<typename T, typename F> void combine(T& resource, F& f) {
+            auto* const posted = post<T>(f);
+            if(posted == nullptr) {
+                // every slot is taken
+                std::unique_lock<L> guard {lock_};
+                apply_posted(&resource);
+                f(resource);
+                return;
+            }
+
+            pause_yield_backoff<> backoff;
+            while(posted->state.load(std::memory_order_acquire) == pending) {
+                if(lock_.try_lock()) {
+                    apply_posted(&resource);
+                    lock_.unlock();
+                    break;
+                }
+                backoff.wait(posted->state, pending);
+            }
+
+            auto error = std::move(posted->error);
+            posted->state.store(free, std::memory_order_release);
+            if(error)
+                std::rethrow_exception(error);
+        }
+
+    private:
+        static constexpr std::uint32_t free = 0;
+        static constexpr std::uint32_t claimed = 1;
+        static constexpr std::uint32_t pending = 2;
+        static constexpr std::uint32_t done = 3;
+
+        struct slot {
+            std::atomic<std::uint32_t> state {free};
+            void* operation {nullptr};
+            void (*apply)(void* operation, void* resource) {nullptr};
+            std::exception_ptr error;
+        };
+
+        L lock_;
+        cache_aligned_array<slot, Slots> slots_;
+
+
+        template<typename T, typename F> slot* post(F& f) noexcept {
+            auto const first = detail::this_thread_index();
+            for(std::size_t i = 0; i != Slots; ++i) {
+                auto& s = slots_[(first + i) % Slots];
+                auto expected = free;
+                if(!s.state.compare_exchange_strong(expected,
+                                                    claimed,
+                                                    std::memory_order_acquire,
+                                                    std::memory_order_relaxed))
+                    continue;
+                s.operation = &f;
+                s.apply = [](void* operation, void* resource) {
+                    (*static_cast<F*>(operation))(*static_cast<T*>(resource));
+                };
+                s.state.store(pending, std::memory_order_release);
+                return &s;
+            }
+            return nullptr;
+        }
+
+
+        // Called with L locked
+        void apply_posted(void* resource) noexcept {
+            for(auto& s: slots_) {
+                if(s.state.load(std::memory_order_acquire) != pending)
+                    continue;
+                try {
+                    s.apply(s.operation, resource);
+                } catch(...) {
+                    s.error = std::current_exception();
+                }
+                s.state.store(done, std::memory_order_release);
+            }
+        }
+
+    };   // flat_combining
+
+
+#if defined(USYNC_HAS_COROUTINES)
+
+    namespace detail {
+
+
+        // Suspended coroutine in intrusive list, resumed inline or through
+        // executor, i.e. callable taking std::coroutine_handle<>
+        struct async_waiter {
+            async_waiter* next {nullptr};
+            std::coroutine_handle<> handle;
+            void* executor {nullptr};
+            void (*schedule)(void* executor, std::coroutine_handle<> handle) {nullptr};
+
+            async_waiter() noexcept = default;
+
+            template<typename E>
+            explicit async_waiter(E& e) noexcept
+                : executor(&e), schedule([](void* to, std::coroutine_handle<> h) {
+                      (*static_cast<E*>(to))(h);
+                  }) {}
+
+            void resume() {
+                if(schedule != nullptr)
+                    schedule(executor, handle);
+                else
+                    handle.resume();
+            }
+        };
+
+
+    }   // namespace detail
+
+
+    // Lock that suspends awaiting coroutines instead of blocking thread,
+    // unlock() passes ownership to the first suspended one and resumes it.
+    // Waiters live in coroutine frames, nothing is allocated
+    class async_lock {
+    public:
+
+        struct awaiter: detail::async_waiter {
+            explicit awaiter(async_lock& lock) noexcept: lock_(lock) {}
+
+            template<typename E>
+            awaiter(async_lock& lock, E& executor) noexcept
+                : detail::async_waiter(executor), lock_(lock) {}
+
+            bool await_ready() const noexcept { return false; }
+
+
+            bool await_suspend(std::coroutine_handle<> suspended) noexcept {
+                handle = suspended;
+                auto const self = reinterpret_cast<std::uintptr_t>(static_cast<async_waiter*>(this));
+                auto state = lock_.state_.load(std::memory_order_acquire);
+                for(;;) {
+                    if(state == unlocked) {
+                        if(lock_.state_.compare_exchange_weak(state,
+                                                              locked,
+                                                              std::memory_order_acquire,
+                                                              std::memory_order_acquire))
+                            return false;
+                        continue;
+                    }
+                    next = state == locked ? nullptr : reinterpret_cast<async_waiter*>(state);
+                    if(lock_.state_.compare_exchange_weak(state,
+                                                          self,
+                                                          std::memory_order_release,
+                                                          std::memory_order_acquire))
+                        return true;
+                }
+            }
+
+
+            void await_resume() const noexcept {}
+
+        private:
+            async_lock& lock_;
+        };   // awaiter
+
+
+        async_lock() noexcept = default;
+        async_lock(async_lock const&) noexcept = delete;
+        async_lock& operator=(async_lock const&) noexcept = delete;
+
+
+        // co_await lock.lock_async(); resumes inside unlock() of previous owner
+        awaiter lock_async() noexcept { return awaiter {*this}; }
+
+
+        // Resumed coroutine is handed to executor(handle)
+        template<typename E> awaiter lock_async(E& executor) noexcept {
+            return awaiter {*this, executor};
+        }
+
+
+        bool try_lock() noexcept {
+            auto expected = unlocked;
+            return state_.compare_exchange_strong(expected,
+                                                  locked,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+        }
+
+
+        void unlock() {
+            auto* head = waiters_;
+            if(head == nullptr) {
+                auto expected = locked;
+                if(state_.compare_exchange_strong(expected,
+                                                  unlocked,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed))
+                    return;
+
+                // take newly suspended ones in arrival order, stay locked
+                auto* pushed = reinterpret_cast<detail::async_waiter*>(
+                    state_.exchange(locked, std::memory_order_acquire));
+                while(pushed != nullptr) {
+                    auto* next = pushed->next;
+                    pushed->next = head;
+                    head = pushed;
+                    pushed = next;
+                }
+            }
+
+            waiters_ = head->next;
+            head->resume();
+        }
+
+
+        // For threads outside coroutines
+        void lock() noexcept {
+            for(std::uint32_t polls = 0; !try_lock(); ++polls)
+                if(polls < detail::default_spins)
+                    relax();
+                else
+                    std::this_thread::yield();
+        }
+
+
+        bool try_lock_shared() noexcept { return try_lock(); }
+
+
+        void unlock_shared() { unlock(); }
+
+
+        void lock_shared() noexcept { lock(); }
+
+    private:
+        static constexpr std::uintptr_t locked = 0;
+        static constexpr std::uintptr_t unlocked = 1;
+
+        // unlocked, locked or the last suspended waiter
+        std::atomic<std::uintptr_t> state_ {unlocked};
+        // suspended waiters in arrival order, guarded by the lock itself
+        detail::async_waiter* waiters_ {nullptr};
+
+    };   // async_lock
+
+#endif   // USYNC_HAS_COROUTINES
+
+
+    struct lock_statistics {
+        std::uint64_t acquisitions {0};
+        std::uint64_t shared_acquisitions {0};
+        std::uint64_t contentions {0};        // acquisitions that had to wait
+        std::uint64_t failed_try_locks {0};
+        std::uint64_t spins {0};
+        std::uint64_t wait_ns {0};
+        std::uint64_t hold_ns {0};            // for exclusive and outermost shared holds per slot
+    };
+
+
+    // Lock policy wrapper counting acquisitions, contention, waiting and
+    // holding time in per-thread counters; instrumented<L, false> is just L
+    template<typename L, bool Enabled = true, std::size_t Slots = 16>
+    class instrumented {
+    public:
+        static_assert(Slots > 0);
+
+        using lock_type = L;
+
+        instrumented() noexcept = default;
+        instrumented(instrumented const&) noexcept = delete;
+        instrumented& operator=(instrumented const&) noexcept = delete;
+
+
+        bool try_lock() noexcept {
+            if(!lock_.try_lock()) {
+                add(this_thread_counters().failed_try_locks, 1);
+                return false;
+            }
+            add(this_thread_counters().acquisitions, 1);
+            acquired_at_ = now();
+            return true;
+        }
+
+
+        void unlock() noexcept {
+            add(this_thread_counters().hold_ns, now() - acquired_at_);
+            lock_.unlock();
+        }
+
+
+        void lock() noexcept {
+            auto& c = this_thread_counters();
+            if(!lock_.try_lock())
+                wait(c, [this]() noexcept { return lock_.try_lock(); },
+                     [this]() noexcept { lock_.lock(); });
+            add(c.acquisitions, 1);
+            acquired_at_ = now();
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_until(std::chrono::time_point<Clock, Duration> const& deadline) {
+            if(!detail::try_lock_until(lock_, deadline)) {
+                add(this_thread_counters().failed_try_locks, 1);
+                return false;
+            }
+            add(this_thread_counters().acquisitions, 1);
+            acquired_at_ = now();
+            return true;
+        }
+
+
+        bool try_lock_shared() noexcept {
+            if(!lock_.try_lock_shared()) {
+                add(this_thread_counters().failed_try_locks, 1);
+                return false;
+            }
+            acquired_shared();
+            return true;
+        }
+
+
+        void unlock_shared() noexcept {
+            auto& c = this_thread_counters();
+            // stable while this hold keeps shared_depth above zero
+            auto const since = c.shared_since.load(std::memory_order_relaxed);
+            if(c.shared_depth.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                add(c.hold_ns, now() - since);
+            lock_.unlock_shared();
+        }
+
+
+        void lock_shared() noexcept {
+            if(!lock_.try_lock_shared())
+                wait(this_thread_counters(),
+                     [this]() noexcept { return lock_.try_lock_shared(); },
+                     [this]() noexcept { lock_.lock_shared(); });
+            acquired_shared();
+        }
+
+
+        template<class Rep, class Period>
+        bool try_lock_shared_for(std::chrono::duration<Rep, Period> const& timeout) noexcept {
+            return try_lock_shared_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        bool try_lock_shared_until(std::chrono::time_point<Clock, Duration> const& deadline) {
+            if(!detail::try_lock_shared_until(lock_, deadline)) {
+                add(this_thread_counters().failed_try_locks, 1);
+                return false;
+            }
+            acquired_shared();
+            return true;
+        }
+
+
+        lock_statistics snapshot() const noexcept {
+            lock_statistics total;
+            for(auto const& c: counters_) {
+                total.acquisitions += c.acquisitions.load(std::memory_order_relaxed);
+                total.shared_acquisitions +=
+                    c.shared_acquisitions.load(std::memory_order_relaxed);
+                total.contentions += c.contentions.load(std::memory_order_relaxed);
+                total.failed_try_locks += c.failed_try_locks.load(std::memory_order_relaxed);
+                total.spins += c.spins.load(std::memory_order_relaxed);
+                total.wait_ns += c.wait_ns.load(std::memory_order_relaxed);
+                total.hold_ns += c.hold_ns.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+
+        L& underlying() noexcept { return lock_; }
+
+    private:
+        // spin on try_lock() for a while to count spins, then block in L
+        static constexpr std::uint64_t spin_limit = 64;
+        // shared_depth while the outermost shared hold records its start
+        static constexpr std::uint64_t opening = ~std::uint64_t {0};
+
+        struct counters {
+            std::atomic<std::uint64_t> acquisitions {0};
+            std::atomic<std::uint64_t> shared_acquisitions {0};
+            std::atomic<std::uint64_t> contentions {0};
+            std::atomic<std::uint64_t> failed_try_locks {0};
+            std::atomic<std::uint64_t> spins {0};
+            std::atomic<std::uint64_t> wait_ns {0};
+            std::atomic<std::uint64_t> hold_ns {0};
+            // shared holds of this lock by the threads of the slot
+            std::atomic<std::uint64_t> shared_depth {0};
+            std::atomic<std::uint64_t> shared_since {0};
+        };
+
+        L lock_;
+        std::uint64_t acquired_at_ {0};
+        cache_aligned_array<counters, Slots> counters_;
+
+
+        static std::uint64_t now() noexcept {
+            auto const since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+            return std::uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count());
+        }
+
+
+        static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) noexcept {
+            counter.fetch_add(n, std::memory_order_relaxed);
+        }
+
+
+        counters& this_thread_counters() noexcept {
+            return counters_[detail::this_thread_index() % Slots];
+        }
+
+
+        // overlapping shared holds of this lock within a slot are timed as one
+        void acquired_shared() noexcept {
+            auto& c = this_thread_counters();
+            add(c.shared_acquisitions, 1);
+            auto depth = c.shared_depth.load(std::memory_order_relaxed);
+            for(;;) {
+                if(depth == opening) {
+                    relax();
+                    depth = c.shared_depth.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if(c.shared_depth.compare_exchange_weak(depth,
+                                                        depth == 0 ? opening : depth + 1,
+                                                        std::memory_order_acquire,
+                                                        std::memory_order_relaxed))
+                    break;
+            }
+            if(depth == 0) {
+                c.shared_since.store(now(), std::memory_order_relaxed);
+                c.shared_depth.store(1, std::memory_order_release);
+            }
+        }
+
+
+        template<typename TryLock, typename Lock>
+        static void wait(counters& c, TryLock&& try_lock, Lock&& lock) noexcept {
+            auto const begin = now();
+            std::uint64_t spins = 1;
+            for(; spins != spin_limit; ++spins) {
+                relax();
+                if(try_lock())
+                    break;
+            }
+            if(spins == spin_limit)
+                lock();
+            add(c.contentions, 1);
+            add(c.spins, spins);
+            add(c.wait_ns, now() - begin);
+        }
+
+    };   // instrumented
+
+
+    template<typename L, std::size_t Slots>
+    class instrumented<L, false, Slots>: public L {
+    public:
+        using lock_type = L;
+
+        lock_statistics snapshot() const noexcept { return {}; }
+        L& underlying() noexcept { return *this; }
+
+    };   // instrumented
+
+
+    namespace detail {
+
+
+        template<typename L> struct is_combining: std::false_type {};
+
+        template<typename L, std::size_t Slots>
+        struct is_combining<flat_combining<L, Slots>>: std::true_type {};
+
+
+        template<typename L, typename = void> struct is_optimistic: std::false_type {};
+
+        template<typename L>
+        struct is_optimistic<L, std::void_t<decltype(std::declval<L const&>().read_begin())>>
+            : std::true_type {};
+
+
+        // Copy of the resource in relaxed atomic words, stored by writers
+        // before they unlock, so optimistic readers never touch the resource
+        // that writers modify; empty base of synchronized otherwise
+        template<typename T, bool Enabled> struct optimistic_copy {
+            void store(T const&) noexcept {}
+        };
+
+        template<typename T> struct optimistic_copy<T, true> {
+            using word = std::uintptr_t;
+            static constexpr std::size_t size = (sizeof(T) + sizeof(word) - 1) / sizeof(word);
+
+            std::atomic<word> words[size];
+
+            void store(T const& value) noexcept {
+                word buffer[size] {};
+                std::memcpy(buffer, &value, sizeof(T));
+                for(std::size_t i = 0; i != size; ++i)
+                    words[i].store(buffer[i], std::memory_order_relaxed);
+            }
+
+            void load(void* to) const noexcept {
+                word buffer[size];
+                for(std::size_t i = 0; i != size; ++i)
+                    buffer[i] = words[i].load(std::memory_order_relaxed);
+                std::memcpy(to, buffer, sizeof(T));
+            }
+        };
+
+        template<typename T, typename L>
+        using optimistic_copy_of =
+            optimistic_copy<T, is_optimistic<L>::value && std::is_trivially_copyable_v<T>>;
+
+
+    }   // namespace detail
+
+
+    template<typename T, typename L = spinlock>
+    struct synchronized: private detail::optimistic_copy_of<T, L> {
+        using resource_type = T;
+
+        struct unique_access {
+            unique_access() = delete;
+            unique_access(unique_access const&) = delete;
+            unique_access& operator=(unique_access const&) = delete;
+
+            unique_access(unique_access&&) noexcept = default;
+
+            unique_access(synchronized& owner) noexcept
+                : guard_(owner.lock_), owner_(owner) {}
+
+            // Takes ownership of already locked owner
+            unique_access(synchronized& owner, std::adopt_lock_t) noexcept
+                : guard_(owner.lock_, std::adopt_lock), owner_(owner) {}
+
+            ~unique_access() {
+                if(guard_.owns_lock())
+                    owner_.publish();
+            }
+
+            T& operator*() const noexcept { return owner_.resource_; }
+            T* operator->() const noexcept { return &owner_.resource_; }
+            template<typename F> void run(F&& f) { f(owner_.resource_); }
+
+        private:
+            std::unique_lock<L> guard_;
+            synchronized& owner_;
+
+        };   // unique_access
+
+
+        struct shared_access {
+            shared_access() = delete;
+            shared_access(shared_access const&) = delete;
+            shared_access& operator=(shared_access const&) = delete;
+
+            shared_access(shared_access&&) noexcept = default;
+
+            shared_access(synchronized const& owner) noexcept
+                : guard_(owner.lock_), resource_(owner.resource_) {}
+
+            // Takes ownership of already shared locked owner
+            shared_access(synchronized const& owner, std::adopt_lock_t) noexcept
+                : guard_(owner.lock_, std::adopt_lock), resource_(owner.resource_) {}
+
+            T const& operator*() const noexcept { return resource_; }
+            T const* operator->() const noexcept { return &resource_; }
+            template<typename F> void run(F&& f) { f(resource_); }
+
+        private:
+            std::shared_lock<L> guard_;
+            T const& resource_;
+
+        };   // shared_access
+
+
+        // Shared access that can become unique without releasing the lock,
+        // requires lock policy with upgradable ownership (shared_spinlock)
+        struct upgradable_access {
+            upgradable_access() = delete;
+            upgradable_access(upgradable_access const&) = delete;
+            upgradable_access& operator=(upgradable_access const&) = delete;
+
+            upgradable_access(synchronized& owner) noexcept: owner_(owner) {
+                owner_.lock_.lock_upgrade();
+            }
+
+            ~upgradable_access() {
+                if(upgraded_)
+                    owner_.lock_.unlock();
+                else
+                    owner_.lock_.unlock_upgrade();
+            }
+
+            T const& operator*() const noexcept { return owner_.resource_; }
+            T const* operator->() const noexcept { return &owner_.resource_; }
+            template<typename F> void run(F&& f) { f(std::as_const(owner_.resource_)); }
+
+            bool upgraded() const noexcept { return upgraded_; }
+
+            // Waits for readers to leave
+            T& upgrade() noexcept {
+                if(!upgraded_) {
+                    owner_.lock_.upgrade();
+                    upgraded_ = true;
+                }
+                return owner_.resource_;
+            }
+
+            // nullptr while there are other readers
+            T* try_upgrade() noexcept {
+                if(!upgraded_) {
+                    if(!owner_.lock_.try_upgrade())
+                        return nullptr;
+                    upgraded_ = true;
+                }
+                return &owner_.resource_;
+            }
+
+        private:
+            synchronized& owner_;
+            bool upgraded_ {false};
+
+        };   // upgradable_access
+
+
+        // Snapshot of the resource taken without writing to shared memory,
+        // requires lock policy with read_begin() and read_retry(); it's
+        // read from the copy writers publish, never from the resource
+        struct optimistic_access {
+            optimistic_access() = delete;
+            optimistic_access(optimistic_access const&) = delete;
+            optimistic_access& operator=(optimistic_access const&) = delete;
+
+            optimistic_access(synchronized const& owner) noexcept {
+                static_assert(std::is_trivially_copyable_v<T>);
+                for(;;) {
+                    auto const sequence = owner.lock_.read_begin();
+                    // may overlap with a writer, torn copies are discarded
+                    owner.published().load(snapshot_);
+                    if(!owner.lock_.read_retry(sequence))
+                        break;
+                }
+            }
+
+            T const& operator*() const noexcept { return *get(); }
+            T const* operator->() const noexcept { return get(); }
+            template<typename F> void run(F&& f) { f(*get()); }
+
+        private:
+            alignas(T) unsigned char snapshot_[sizeof(T)];
+
+            T const* get() const noexcept {
+                return std::launder(reinterpret_cast<T const*>(snapshot_));
+            }
+
+        };   // optimistic_access
+
+
+        synchronized(): resource_() { publish(); }
+        synchronized(synchronized const&) = delete;
+        synchronized& operator=(synchronized const&) = delete;
+        synchronized(synchronized&&) = default;
+        synchronized& operator=(synchronized&&) = default;
+
+        template<typename... Args>
+        synchronized(Args&&... args): resource_(std::forward<Args>(args)...) { publish(); }
+
+        // Lock policy itself, e.g. for statistics of instrumented<L>
+        L& policy() const noexcept { return lock_; }
+
+
+#if defined(USYNC_HAS_COROUTINES)
+        // co_await shared.unique_async() suspends coroutine until access
+        // is granted, requires async_lock policy
+        struct unique_awaiter {
+            typename L::awaiter lock;
+            synchronized& owner;
+
+            bool await_ready() const noexcept { return lock.await_ready(); }
+
+            bool await_suspend(std::coroutine_handle<> suspended) noexcept {
+                return lock.await_suspend(suspended);
+            }
+
+            unique_access await_resume() const noexcept { return {owner, std::adopt_lock}; }
+        };   // unique_awaiter
+
+
+        unique_awaiter unique_async() noexcept { return {lock_.lock_async(), *this}; }
+
+
+        template<typename E> unique_awaiter unique_async(E& executor) noexcept {
+            return {lock_.lock_async(executor), *this};
+        }
+#endif   // USYNC_HAS_COROUTINES
+
+
+        // Empty if the lock isn't taken in time, so caller can shed load
+        template<class Rep, class Period>
+        std::optional<unique_access> try_unique_access(
+            std::chrono::duration<Rep, Period> const& timeout) {
+            std::optional<unique_access> access;
+            if(detail::try_lock_until(lock_, std::chrono::steady_clock::now() + timeout))
+                access.emplace(*this, std::adopt_lock);
+            return access;
+        }
+
+
+        template<class Rep, class Period>
+        std::optional<shared_access> try_shared_access(
+            std::chrono::duration<Rep, Period> const& timeout) const {
+            std::optional<shared_access> access;
+            if(detail::try_lock_shared_until(lock_, std::chrono::steady_clock::now() + timeout))
+                access.emplace(*this, std::adopt_lock);
+            return access;
+        }
+
+
+        // Applies f to the resource under lock; flat_combining policy
+        // batches it with operations submitted by other threads
+        template<typename F> void submit(F&& f) {
+            if constexpr(detail::is_combining<L>::value) {
+                lock_.template combine<T>(resource_, f);
+            } else {
+                unique_access access {*this};
+                f(resource_);
+            }
+        }
+
+    private:
+        mutable L lock_;
+        T resource_;
+
+
+        detail::optimistic_copy_of<T, L> const& published() const noexcept { return *this; }
+
+
+        void publish() noexcept { detail::optimistic_copy_of<T, L>::store(resource_); }
+
+    };   // synchronized
+
+
+    namespace detail {
+
+
+        template<typename S> struct access_of;
+
+        template<typename T, typename L>
+        struct access_of<synchronized<T, L>> {
+            using type = typename synchronized<T, L>::unique_access;
+
+            static void lock(void* s) noexcept {
+                static_cast<synchronized<T, L>*>(s)->policy().lock();
+            }
+
+            static bool try_lock(void* s) noexcept {
+                return static_cast<synchronized<T, L>*>(s)->policy().try_lock();
+            }
+
+            static void unlock(void* s) noexcept {
+                static_cast<synchronized<T, L>*>(s)->policy().unlock();
+            }
+        };
+
+        template<typename T, typename L>
+        struct access_of<synchronized<T, L> const> {
+            using type = typename synchronized<T, L>::shared_access;
+
+            static void lock(void* s) noexcept {
+                static_cast<synchronized<T, L> const*>(s)->policy().lock_shared();
+            }
+
+            static bool try_lock(void* s) noexcept {
+                return static_cast<synchronized<T, L> const*>(s)->policy().try_lock_shared();
+            }
+
+            static void unlock(void* s) noexcept {
+                static_cast<synchronized<T, L> const*>(s)->policy().unlock_shared();
+            }
+        };
+
+
+        struct lockable_ref {
+            void* object;
+            void (*lock)(void*) noexcept;
+            bool (*try_lock)(void*) noexcept;
+            void (*unlock)(void*) noexcept;
+        };
+
+
+        template<std::size_t N>
+        bool distinct(lockable_ref const (&locks)[N]) noexcept {
+            for(std::size_t i = 1; i < N; ++i)
+                for(std::size_t j = 0; j != i; ++j)
+                    if(locks[i].object == locks[j].object)
+                        return false;
+            return true;
+        }
+
+
+        // Blocks on one lock and tries the others; on failure releases
+        // everything and starts over with the lock that was busy
+        template<std::size_t N>
+        void lock_all(lockable_ref const (&locks)[N]) noexcept {
+            std::size_t first = 0;
+            for(;;) {
+                locks[first].lock(locks[first].object);
+                std::size_t busy = first;
+                for(std::size_t i = 1; i != N; ++i) {
+                    auto const next = (first + i) % N;
+                    if(!locks[next].try_lock(locks[next].object)) {
+                        busy = next;
+                        break;
+                    }
+                }
+                if(busy == first)
+                    return;
+                for(auto i = first; i != busy; i = (i + 1) % N)
+                    locks[i].unlock(locks[i].object);
+                first = busy;
+                std::this_thread::yield();
+            }
+        }
+
+
+    }   // namespace detail
+
+
+    // Locks every synchronized resource without deadlock and returns tuple
+    // of accessors: unique_access for mutable resources, shared_access for
+    // const ones, e.g. synchronize(account, std::as_const(position));
+    // throws std::invalid_argument if a resource is passed more than once
+    template<typename... S>
+    std::tuple<typename detail::access_of<S>::type...> synchronize(S&... resources) {
+        static_assert(sizeof...(S) > 0);
+        detail::lockable_ref const locks[] = {detail::lockable_ref {
+            const_cast<void*>(static_cast<void const*>(&resources)),
+            &detail::access_of<S>::lock,
+            &detail::access_of<S>::try_lock,
+            &detail::access_of<S>::unlock}...};
+        // otherwise lock_all() retries forever on the lock it holds
+        if(!detail::distinct(locks))
+            throw std::invalid_argument {"usync::synchronize: resource passed twice"};
+        detail::lock_all(locks);
+        return std::tuple<typename detail::access_of<S>::type...>(
+            typename detail::access_of<S>::type(resources, std::adopt_lock)...);
+    }
+
+
+    // N cache aligned synchronized shards of T, updates go to the shard of
+    // current CPU, thread or key, aggregated reads visit every shard
+    template<typename T, typename L = spinlock, std::size_t N = 16>
+    class sharded {
+        cache_aligned_array<synchronized<T, L>, N> shards_;
+
+    public:
+
+        using resource_type = T;
+        using shard_type = synchronized<T, L>;
+        using unique_access = typename shard_type::unique_access;
+        using shared_access = typename shard_type::shared_access;
+
+        static constexpr std::size_t shard_count = N;
+
+        sharded() = default;
+        sharded(sharded const&) = delete;
+        sharded& operator=(sharded const&) = delete;
+
+        shard_type& shard_at(std::size_t index) noexcept { return shards_[index % N]; }
+        shard_type const& shard_at(std::size_t index) const noexcept { return shards_[index % N]; }
+
+        // Shard of current CPU, thread may migrate while it holds access
+        unique_access local_access() noexcept { return {shard_at(detail::current_cpu())}; }
+
+        unique_access thread_access() noexcept {
+            return {shard_at(detail::this_thread_index())};
+        }
+
+        template<typename K> unique_access access(K const& key) {
+            return {shard_at(std::hash<K> {}(key))};
+        }
+
+        template<typename K> shared_access shared(K const& key) const {
+            return {shard_at(std::hash<K> {}(key))};
+        }
+
+        // Visits shards one by one in shared mode, result isn't atomic
+        // snapshot of all shards
+        template<typename F> void for_each_shard(F&& f) const {
+            for(auto const& s: shards_) {
+                shared_access access {s};
+                f(*access);
+            }
+        }
+
+        template<typename R, typename F> R reduce(R init, F&& f) const {
+            for_each_shard([&](T const& resource) { init = f(std::move(init), resource); });
+            return init;
+        }
+
+    };   // sharded
+
+
+    // Awaiting threads spin for Spins pauses before they park,
+    // setting the value wakes one of them
+    template<typename T, std::size_t Spins = detail::default_spins>
+    class promise {
+        T value_;
+        std::atomic<std::uint32_t> event_ {0};
+
+    public:
+
+        promise() = default;
+        promise(promise const&) = delete;
+        promise& operator = (promise const&) = delete;
+
+        promise& operator = (T const& value) {
+            value_ = value;
+            set();
+            return *this;
+        }
+
+
+        promise& operator = (T&& value) {
+            value_ = std::move(value);
+            set();
+            return *this;
+        }
+
+
+        bool ready() const noexcept {
+            return event_.load(std::memory_order_acquire) != 0;
+        }
+
+
+        // Value if it's already set, nullptr otherwise
+        T const* try_get() const noexcept {
+            return ready() ? &value_ : nullptr;
+        }
+
+
+        T const& await() const& noexcept {
+            detail::await_change<Spins>(event_, 0);
+            return value_;
+        }
+
+
+        T&& await() && noexcept {
+            detail::await_change<Spins>(event_, 0);
+            return std::move(value_);
+        }
+
+
+        // Value or nullptr on timeout
+        template<class Rep, class Period>
+        T const* await_for(std::chrono::duration<Rep, Period> const& timeout) const noexcept {
+            return await_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+
+        template<class Clock, class Duration>
+        T const* await_until(std::chrono::time_point<Clock, Duration> const& deadline) const noexcept {
+            if(!detail::await_change_until<Spins>(event_, 0, deadline))
+                return nullptr;
+            return &value_;
+        }
+
+
+        void clear() {
+            event_.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+
+        void set() noexcept {
+            event_.store(1, std::memory_order_release);
+            detail::unpark_one(event_);
+        }
+
+    }; // promise
+
+
+    // Setting the value wakes every awaiting thread. Each value starts new
+    // generation, so consumers can await the value following the one they
+    // have seen; the producer shouldn't overwrite the value being read
+    template<typename T, std::size_t Spins = detail::default_spins>
+    class broadcast_promise {
+        T value_;
+        std::atomic<std::uint32_t> generation_ {0};
+
+    public:
+
+        broadcast_promise() = default;
+        broadcast_promise(broadcast_promise const&) = delete;
+        broadcast_promise& operator = (broadcast_promise const&) = delete;
+
+        broadcast_promise& operator = (T const& value) {
+            value_ = value;
+            publish();
+            return *this;
+        }
+
+
+        broadcast_promise& operator = (T&& value) {
+            value_ = std::move(value);
+            publish();
+            return *this;
+        }
+
+
+        // Number of values set so far
+        std::uint32_t generation() const noexcept {
+            return generation_.load(std::memory_order_acquire);
+        }
+
+
+        bool ready() const noexcept { return generation() != 0; }
+
+
+        T const* try_get() const noexcept {
+            return ready() ? &value_ : nullptr;
+        }
+
+
+        T const& await() const noexcept {
+            return await_next(0);
+        }
+
+
+        // Awaits value of any generation after seen one
+        T const& await_next(std::uint32_t seen) const noexcept {
+            detail::await_change<Spins>(generation_, seen);
+            return value_;
+        }
+
+
+        // Value or nullptr on timeout
+        template<class Rep, class Period>
+        T const* await_next_for(std::uint32_t seen,
+                                std::chrono::duration<Rep, Period> const& timeout) const noexcept {
+            auto const deadline = std::chrono::steady_clock::now() + timeout;
+            if(!detail::await_change_until<Spins>(generation_, seen, deadline))
+                return nullptr;
+            return &value_;
+        }
+
+    private:
+
+        void publish() noexcept {
+            generation_.fetch_add(1, std::memory_order_release);
+            detail::unpark_all(generation_);
+        }
+
+    }; // broadcast_promise
+
+
+#if defined(USYNC_HAS_COROUTINES)
+
+    // Value awaited by coroutines: co_await suspends them until the value
+    // is set, then all of them are resumed inline or through executor
+    template<typename T> class async_promise {
+    public:
+
+        struct awaiter: detail::async_waiter {
+            explicit awaiter(async_promise& promise) noexcept: promise_(promise) {}
+
+            template<typename E>
+            awaiter(async_promise& promise, E& executor) noexcept
+                : detail::async_waiter(executor), promise_(promise) {}
+
+            bool await_ready() const noexcept { return promise_.ready(); }
+
+
+            bool await_suspend(std::coroutine_handle<> suspended) noexcept {
+                handle = suspended;
+                auto const self = reinterpret_cast<std::uintptr_t>(static_cast<async_waiter*>(this));
+                auto state = promise_.state_.load(std::memory_order_acquire);
+                for(;;) {
+                    if(state == set)
+                        return false;
+                    next = reinterpret_cast<detail::async_waiter*>(state);
+                    if(promise_.state_.compare_exchange_weak(state,
+                                                             self,
+                                                             std::memory_order_release,
+                                                             std::memory_order_acquire))
+                        return true;
+                }
+            }
+
+
+            T const& await_resume() const noexcept { return promise_.value_; }
+
+        private:
+            async_promise& promise_;
+        };   // awaiter
+
+
+        async_promise() = default;
+        async_promise(async_promise const&) = delete;
+        async_promise& operator = (async_promise const&) = delete;
+
+        async_promise& operator = (T const& value) {
+            value_ = value;
+            resume_all();
+            return *this;
+        }
+
+
+        async_promise& operator = (T&& value) {
+            value_ = std::move(value);
+            resume_all();
+            return *this;
+        }
+
+
+        bool ready() const noexcept {
+            return state_.load(std::memory_order_acquire) == set;
+        }
+
+
+        T const* try_get() const noexcept {
+            return ready() ? &value_ : nullptr;
+        }
+
+
+        awaiter operator co_await() noexcept { return awaiter {*this}; }
+
+
+        template<typename E> awaiter await_on(E& executor) noexcept {
+            return awaiter {*this, executor};
+        }
+
+
+        // Only while nobody awaits
+        void clear() noexcept {
+            state_.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        // nullptr or the last suspended waiter while value isn't set
+        static constexpr std::uintptr_t set = 1;
+
+        T value_;
+        std::atomic<std::uintptr_t> state_ {0};
+
+        void resume_all() {
+            auto const state = state_.exchange(set, std::memory_order_acq_rel);
+            // value set again, waiters have been resumed already
+            if(state == set)
+                return;
+            auto* waiter = reinterpret_cast<detail::async_waiter*>(state);
+            while(waiter != nullptr) {
+                // resumed coroutine may destroy the waiter
+                auto* next = waiter->next;
+                waiter->resume();
+                waiter = next;
+            }
+        }
+
+    }; // async_promise
+
+#endif   // USYNC_HAS_COROUTINES
+
+
+    // Single-use countdown, the same as C++20 std::latch
+    class latch {
+        std::atomic<std::uint32_t> count_;
+
+    public:
+
+        explicit latch(std::uint32_t expected) noexcept: count_(expected) {}
+        latch(latch const&) = delete;
+        latch& operator = (latch const&) = delete;
+
+        void count_down(std::uint32_t n = 1) noexcept {
+            if(count_.fetch_sub(n, std::memory_order_acq_rel) == n)
+                detail::unpark_all(count_);
+        }
+
+
+        bool try_wait() const noexcept {
+            return count_.load(std::memory_order_acquire) == 0;
+        }
+
+
+        void wait() const noexcept {
+            auto count = count_.load(std::memory_order_acquire);
+            while(count != 0)
+                count = detail::await_change<detail::default_spins>(count_, count);
+        }
+
+
+        void arrive_and_wait(std::uint32_t n = 1) noexcept {
+            count_down(n);
+            wait();
+        }
+
+    }; // latch
+
+
+    // Reusable barrier for a fixed set of threads, the same as C++20
+    // std::barrier without completion function
+    class barrier {
+        alignas(cacheline_size) std::atomic<std::uint32_t> remaining_;
+        std::atomic<std::uint32_t> expected_;
+        alignas(cacheline_size) std::atomic<std::uint32_t> generation_ {0};
+
+    public:
+
+        explicit barrier(std::uint32_t expected) noexcept
+            : remaining_(expected), expected_(expected) {}
+        barrier(barrier const&) = delete;
+        barrier& operator = (barrier const&) = delete;
+
+        void arrive_and_wait() noexcept {
+            auto const generation = generation_.load(std::memory_order_acquire);
+            if(arrive())
+                return;
+            detail::await_change<detail::default_spins>(generation_, generation);
+        }
+
+
+        // Arrives and leaves the set of threads for the next phases
+        void arrive_and_drop() noexcept {
+            expected_.fetch_sub(1, std::memory_order_relaxed);
+            arrive();
+        }
+
+    private:
+
+        // Returns true for the last arriving thread
+        bool arrive() noexcept {
+            if(remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return false;
+            remaining_.store(expected_.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_release);
+            detail::unpark_all(generation_);
+            return true;
+        }
+
+    }; // barrier
+
+
+    template<class T> class pool {
+
+        // nodes move between the lists, so recycled objects keep
+        // their list nodes and remake() doesn't allocate
+        std::list<T> recycled_;
+        std::list<T> in_use_;
+
+    public:
+
+        using pointer = typename std::list<T>::iterator;
+
+        pool() = default;
+        pool(pool const&) = delete;
+        pool& operator = (pool const&) = delete;
+        pool(pool&&) = default;
+        pool& operator = (pool&&) = default;
+
+        pointer remake() {
+            if(recycled_.empty())
+                in_use_.emplace_front();
+            else
+                in_use_.splice(in_use_.begin(), recycled_, recycled_.begin());
+            return in_use_.begin();
+        }
+
+
+        void recycle(pointer it) {
+            recycled_.splice(recycled_.begin(), in_use_, it);
+        }
+
+    }; // pool
+
+    template<class T> using pool_pointer = typename pool<T>::pointer;
+    template<class T> using synchronized_pool = synchronized<pool<T>>;
+
+
+    namespace detail {
+
+
+        // Moves objects between a magazine and pool S in batches, S is any
+        // thread-safe pool with remake() returning empty pointer when
+        // exhausted, e.g. lockfree_pool
+        template<class S> struct magazine_source {
+            using pointer = decltype(std::declval<S&>().remake());
+
+            static void take(S& source, std::vector<pointer>& loaded, std::size_t n) {
+                for(std::size_t i = 0; i != n; ++i) {
+                    auto p = source.remake();
+                    if(!p)
+                        break;
+                    loaded.push_back(p);
+                }
+            }
+
+            static void give(S& source, std::vector<pointer>& loaded, std::size_t n) {
+                for(std::size_t i = 0; i != n; ++i) {
+                    source.recycle(loaded.back());
+                    loaded.pop_back();
+                }
+            }
+        };
+
+
+        // Synchronized pool is locked once per batch
+        template<class T, class L> struct magazine_source<synchronized<pool<T>, L>> {
+            using pointer = pool_pointer<T>;
+
+            static void take(synchronized<pool<T>, L>& source,
+                             std::vector<pointer>& loaded,
+                             std::size_t n) {
+                typename synchronized<pool<T>, L>::unique_access shared {source};
+                for(std::size_t i = 0; i != n; ++i)
+                    loaded.push_back(shared->remake());
+            }
+
+            static void give(synchronized<pool<T>, L>& source,
+                             std::vector<pointer>& loaded,
+                             std::size_t n) {
+                typename synchronized<pool<T>, L>::unique_access shared {source};
+                for(std::size_t i = 0; i != n; ++i) {
+                    shared->recycle(loaded.back());
+                    loaded.pop_back();
+                }
+            }
+        };
+
+
+    }   // namespace detail
+
+
+    // Per-thread stack of pool objects in front of a shared pool S,
+    // refilled from and spilled to it in batches so that most
+    // remake()/recycle() calls stay thread-local
+    template<class S> class basic_pool_magazine {
+
+        using source = detail::magazine_source<S>;
+
+        S& shared_;
+        std::vector<typename source::pointer> loaded_;
+        std::size_t capacity_;
+        std::size_t refill_;
+        std::size_t spill_;
+
+    public:
+
+        using pointer = typename source::pointer;
+
+        explicit basic_pool_magazine(S& shared,
+                                     std::size_t capacity = 64,
+                                     std::size_t refill = 16,
+                                     std::size_t spill = 32)
+            : shared_(shared),
+              capacity_(capacity > 0 ? capacity : 1),
+              refill_(refill > 0 && refill <= capacity_ ? refill : capacity_),
+              spill_(spill > 0 && spill <= capacity_ ? spill : capacity_) {
+            loaded_.reserve(capacity_);
+        }
+
+        basic_pool_magazine(basic_pool_magazine const&) = delete;
+        basic_pool_magazine& operator = (basic_pool_magazine const&) = delete;
+
+        ~basic_pool_magazine() { spill(loaded_.size()); }
+
+        std::size_t size() const noexcept { return loaded_.size(); }
+
+
+        // Empty pointer when shared pool is exhausted
+        pointer remake() {
+            if(loaded_.empty()) {
+                source::take(shared_, loaded_, refill_);
+                if(loaded_.empty())
+                    return pointer {};
+            }
+            auto const p = loaded_.back();
+            loaded_.pop_back();
+            return p;
+        }
+
+
+        void recycle(pointer p) {
+            if(loaded_.size() == capacity_)
+                spill(spill_);
+            loaded_.push_back(p);
+        }
+
+    private:
+
+        void spill(std::size_t n) {
+            if(n != 0)
+                source::give(shared_, loaded_, n);
+        }
+
+    }; // basic_pool_magazine
+
+    template<class T, class L = spinlock>
+    using pool_magazine = basic_pool_magazine<synchronized<pool<T>, L>>;
+
+
+    // Fixed number of objects preallocated in cache-aligned slots,
+    // free slots are kept in a Treiber stack of tagged indices
+    template<class T> class lockfree_pool {
+
+        struct slot {
+            alignas(cacheline_size) T value;
+            std::atomic<std::uint32_t> next {nil};
+        };
+
+        static constexpr std::uint32_t nil = ~std::uint32_t{0};
+
+        std::unique_ptr<slot[]> slots_;
+        std::size_t capacity_;
+        // tag in high half defeats ABA, index of the top slot in low half
+        alignas(cacheline_size) std::atomic<std::uint64_t> free_ {nil};
+
+    public:
+
+        class pointer {
+            friend class lockfree_pool;
+            slot* slot_ {nullptr};
+
+            explicit pointer(slot* s) noexcept: slot_(s) {}
+
+        public:
+            pointer() noexcept = default;
+
+            T& operator * () const noexcept { return slot_->value; }
+            T* operator -> () const noexcept { return &slot_->value; }
+            explicit operator bool () const noexcept { return slot_ != nullptr; }
+
+            bool operator == (pointer const& other) const noexcept {
+                return slot_ == other.slot_;
+            }
+
+            bool operator != (pointer const& other) const noexcept {
+                return slot_ != other.slot_;
+            }
+        }; // pointer
+
+
+        explicit lockfree_pool(std::size_t capacity)
+            : slots_(new slot[capacity]), capacity_(capacity) {
+            for(std::size_t i = 0; i != capacity; ++i)
+                recycle(pointer {&slots_[i]});
+        }
+
+        lockfree_pool(lockfree_pool const&) = delete;
+        lockfree_pool& operator = (lockfree_pool const&) = delete;
+
+        std::size_t capacity() const noexcept { return capacity_; }
+
+
+        // Empty pointer when all objects are in use
+        pointer remake() noexcept {
+            auto top = free_.load(std::memory_order_acquire);
+            for(;;) {
+                auto const index = static_cast<std::uint32_t>(top);
+                if(index == nil)
+                    return pointer {};
+                auto const next = slots_[index].next.load(std::memory_order_relaxed);
+                auto const tagged = ((top >> 32) + 1) << 32 | next;
+                if(free_.compare_exchange_weak(top,
+                                               tagged,
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire))
+                    return pointer {&slots_[index]};
+            }
+        }
+
+
+        void recycle(pointer p) noexcept {
+            auto const index = static_cast<std::uint32_t>(p.slot_ - slots_.get());
+            auto top = free_.load(std::memory_order_relaxed);
+            for(;;) {
+                p.slot_->next.store(static_cast<std::uint32_t>(top),
+                                    std::memory_order_relaxed);
+                auto const tagged = ((top >> 32) + 1) << 32 | index;
+                if(free_.compare_exchange_weak(top,
+                                               tagged,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+    }; // lockfree_pool
+
+    template<class T> using lockfree_pool_pointer = typename lockfree_pool<T>::pointer;
+
+    // Per-thread cache in front of lockfree_pool
+    template<class T> using lockfree_pool_magazine = basic_pool_magazine<lockfree_pool<T>>;
+
+
+    // Up to N objects constructed in place in one cache aligned block,
+    // addressed by 32-bit handles of slot index and generation, so a handle
+    // of recycled object never reaches its successor
+    template<class T, std::size_t N> class arena_pool {
+
+        static_assert(N > 0 && N <= (std::size_t{1} << 24));
+
+        static constexpr std::uint32_t index_bits_of(std::size_t n) noexcept {
+            std::uint32_t bits = 1;
+            while((std::size_t{1} << bits) < n)
+                ++bits;
+            return bits;
+        }
+
+        static constexpr std::uint32_t index_bits = index_bits_of(N);
+        static constexpr std::uint32_t index_mask = (std::uint32_t{1} << index_bits) - 1;
+        static constexpr std::uint32_t generation_limit = std::uint32_t{1} << (32 - index_bits);
+        static constexpr std::uint32_t nil = ~std::uint32_t{0};
+
+        struct slot {
+            alignas(T) unsigned char bytes[sizeof(T)];
+
+            T& value() noexcept { return *std::launder(reinterpret_cast<T*>(bytes)); }
+        };
+
+    public:
+
+        // Zero handle refers to nothing
+        class handle {
+            std::uint32_t value_ {0};
+
+            friend class arena_pool;
+            explicit handle(std::uint32_t value) noexcept: value_(value) {}
+
+        public:
+            handle() noexcept = default;
+
+            std::uint32_t value() const noexcept { return value_; }
+            explicit operator bool () const noexcept { return value_ != 0; }
+            bool operator == (handle const& other) const noexcept { return value_ == other.value_; }
+            bool operator != (handle const& other) const noexcept { return value_ != other.value_; }
+        }; // handle
+
+
+        arena_pool() noexcept {
+            for(std::uint32_t i = 0; i != N; ++i) {
+                next_[i] = i + 1 == N ? nil : i + 1;
+                generations_[i] = 1;
+            }
+        }
+
+        arena_pool(arena_pool const&) = delete;
+        arena_pool& operator = (arena_pool const&) = delete;
+
+        ~arena_pool() {
+            for_each([this](handle h, T&) { destroy(h.value_ & index_mask); });
+        }
+
+
+        static constexpr std::size_t capacity() noexcept { return N; }
+        std::size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+
+        // Empty handle when there is no free slot
+        template<typename... Args> handle remake(Args&&... args) {
+            if(free_ == nil)
+                return handle {};
+            auto const index = free_;
+            new(slots_[index].bytes) T(std::forward<Args>(args)...);
+            free_ = next_[index];
+            live_[index / 64] |= std::uint64_t {1} << index % 64;
+            ++size_;
+            return handle {generations_[index] << index_bits | index};
+        }
+
+
+        // Default constructs up to n objects in a run of free slots,
+        // returns their number; size and live bits are updated per batch
+        template<typename It> std::size_t remake_n(It out, std::size_t n) {
+            std::size_t made = 0;
+            auto free = free_;
+            live_batch live {live_};
+            auto const commit = [&]() noexcept {
+                live.flush();
+                free_ = free;
+                size_ += made;
+            };
+            try {
+                while(made != n && free != nil) {
+                    auto const index = free;
+                    new(slots_[index].bytes) T();
+                    free = next_[index];
+                    ++made;
+                    live.toggle(index);
+                    *out = handle {generations_[index] << index_bits | index};
+                    ++out;
+                }
+            } catch(...) {
+                commit();
+                throw;
+            }
+            commit();
+            return made;
+        }
+
+
+        // Stale handles are ignored
+        void recycle(handle h) {
+            if(get(h) == nullptr)
+                return;
+            auto const index = h.value_ & index_mask;
+            destroy(index);
+            auto const generation = generations_[index] + 1;
+            generations_[index] = generation == generation_limit ? 1 : generation;
+            next_[index] = free_;
+            free_ = index;
+        }
+
+
+        // Recycled slots are pushed to the free list as one run
+        template<typename It> void recycle_n(It first, std::size_t n) {
+            auto free = free_;
+            std::size_t recycled = 0;
+            live_batch live {live_};
+            for(std::size_t i = 0; i != n; ++i, ++first) {
+                handle const h = *first;
+                // bumped generation makes repeated handle stale
+                if(get(h) == nullptr)
+                    continue;
+                auto const index = h.value_ & index_mask;
+                slots_[index].value().~T();
+                live.toggle(index);
+                auto const generation = generations_[index] + 1;
+                generations_[index] = generation == generation_limit ? 1 : generation;
+                next_[index] = free;
+                free = index;
+                ++recycled;
+            }
+            live.flush();
+            free_ = free;
+            size_ -= recycled;
+        }
+
+
+        // nullptr for empty or stale handle
+        T* get(handle h) noexcept {
+            auto const index = h.value_ & index_mask;
+            if(!h || index >= N || generations_[index] != h.value_ >> index_bits
+               || (live_[index / 64] >> index % 64 & 1) == 0)
+                return nullptr;
+            return &slots_[index].value();
+        }
+
+
+        T const* get(handle h) const noexcept {
+            return const_cast<arena_pool*>(this)->get(h);
+        }
+
+
+        // Calls f(handle, T&) for live objects in slot order
+        template<typename F> void for_each(F&& f) {
+            for(std::uint32_t word = 0; word != live_words; ++word) {
+                for(auto bits = live_[word]; bits != 0; bits &= bits - 1) {
+                    auto const index = std::uint32_t(word * 64 + detail::countr_zero(bits));
+                    f(handle {generations_[index] << index_bits | index}, slots_[index].value());
+                }
+            }
+        }
+
+    private:
+        static constexpr std::size_t live_words = (N + 63) / 64;
+
+        alignas(cacheline_size) slot slots_[N];
+        std::uint32_t generations_[N];
+        std::uint32_t next_[N];
+        std::uint64_t live_[live_words] {};
+        std::uint32_t free_ {0};
+        std::size_t size_ {0};
+
+        void destroy(std::uint32_t index) noexcept {
+            slots_[index].value().~T();
+            live_[index / 64] &= ~(std::uint64_t {1} << index % 64);
+            --size_;
+        }
+
+
+        // Flips live bits of a batch, writing each run of one word once
+        struct live_batch {
+            std::uint64_t (&live)[live_words];
+            std::uint32_t word {nil};
+            std::uint64_t bits {0};
+
+            void toggle(std::uint32_t index) noexcept {
+                if(index / 64 != word) {
+                    flush();
+                    word = index / 64;
+                }
+                bits |= std::uint64_t {1} << index % 64;
+            }
+
+            void flush() noexcept {
+                if(word != nil)
+                    live[word] ^= bits;
+                bits = 0;
+            }
+        };
+
+    }; // arena_pool
+
+
+    // Fixed size buffers carved out of caller supplied memory, e.g. mmap'ed
+    // hugepages or POSIX shared memory; buffers are addressed by offsets
+    // from the region start and the free list is a Treiber stack inside the
+    // region, so processes mapping it at different addresses share buffers
+    class buffer_pool {
+
+        static constexpr std::uint64_t signature = 0x66756263'6e797375;   // "usyncbuf"
+        static constexpr std::uint32_t nil = ~std::uint32_t{0};
+
+        struct header {
+            std::atomic<std::uint64_t> signature {0};
+            std::uint64_t stride {0};
+            std::uint64_t count {0};
+            std::uint64_t links {0};     // offset of next indices
+            std::uint64_t buffers {0};   // offset of the first buffer
+            // tag in high half defeats ABA, index of the top buffer in low half
+            alignas(cacheline_size) std::atomic<std::uint64_t> free {nil};
+        };
+
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+        static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+        unsigned char* base_ {nullptr};
+
+        explicit buffer_pool(void* region) noexcept
+            : base_(static_cast<unsigned char*>(region)) {}
+
+        header& head() const noexcept { return *reinterpret_cast<header*>(base_); }
+
+        std::atomic<std::uint32_t>& link(std::uint32_t index) const noexcept {
+            return reinterpret_cast<std::atomic<std::uint32_t>*>(base_ + head().links)[index];
+        }
+
+        static std::uint64_t align_up(std::uint64_t n) noexcept {
+            return (n + cacheline_size - 1) / cacheline_size * cacheline_size;
+        }
+
+    public:
+
+        // Zero offset refers to no buffer
+        using offset = std::uint64_t;
+
+        buffer_pool() noexcept = default;
+
+
+        // Formats cache aligned region for as many buffers as it holds,
+        // the result is empty if region is misaligned or too small
+        static buffer_pool create(void* region,
+                                  std::size_t region_size,
+                                  std::size_t buffer_size) noexcept {
+            if(reinterpret_cast<std::uintptr_t>(region) % cacheline_size != 0
+               || buffer_size == 0)
+                return buffer_pool {};
+
+            auto const header_size = align_up(sizeof(header));
+            auto const stride = align_up(buffer_size);
+            if(region_size <= header_size)
+                return buffer_pool {};
+            auto count = (region_size - header_size) / (stride + sizeof(std::uint32_t));
+            if(count >= nil)
+                count = nil - 1;
+            while(count != 0
+                  && header_size + align_up(count * sizeof(std::uint32_t)) + count * stride
+                         > region_size)
+                --count;
+            if(count == 0)
+                return buffer_pool {};
+
+            auto* h = new(region) header {};
+            h->stride = stride;
+            h->count = count;
+            h->links = header_size;
+            h->buffers = header_size + align_up(count * sizeof(std::uint32_t));
+
+            buffer_pool pool {region};
+            for(std::uint32_t i = 0; i != count; ++i)
+                new(&pool.link(i)) std::atomic<std::uint32_t> {i + 1 == count ? nil : i + 1};
+            h->free.store(0, std::memory_order_relaxed);
+            h->signature.store(signature, std::memory_order_release);
+            return pool;
+        }
+
+
+        // Region created by another process, empty if it isn't formatted
+        static buffer_pool attach(void* region) noexcept {
+            auto const* h = static_cast<header const*>(region);
+            if(h->signature.load(std::memory_order_acquire) != signature)
+                return buffer_pool {};
+            return buffer_pool {region};
+        }
+
+
+        explicit operator bool () const noexcept { return base_ != nullptr; }
+
+        std::size_t buffer_size() const noexcept { return std::size_t(head().stride); }
+        std::size_t capacity() const noexcept { return std::size_t(head().count); }
+
+
+        // Zero when all buffers are in use
+        offset remake() noexcept {
+            auto& free = head().free;
+            auto top = free.load(std::memory_order_acquire);
+            for(;;) {
+                auto const index = static_cast<std::uint32_t>(top);
+                if(index == nil)
+                    return 0;
+                auto const next = link(index).load(std::memory_order_relaxed);
+                auto const tagged = ((top >> 32) + 1) << 32 | next;
+                if(free.compare_exchange_weak(top,
+                                              tagged,
+                                              std::memory_order_acquire,
+                                              std::memory_order_acquire))
+                    return head().buffers + index * head().stride;
+            }
+        }
+
+
+        void recycle(offset buffer) noexcept {
+            auto const index = static_cast<std::uint32_t>((buffer - head().buffers) / head().stride);
+            auto& free = head().free;
+            auto top = free.load(std::memory_order_relaxed);
+            for(;;) {
+                link(index).store(static_cast<std::uint32_t>(top), std::memory_order_relaxed);
+                auto const tagged = ((top >> 32) + 1) << 32 | index;
+                if(free.compare_exchange_weak(top,
+                                              tagged,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+
+        void* data(offset buffer) const noexcept { return base_ + buffer; }
+
+        offset offset_of(void const* buffer) const noexcept {
+            return offset(static_cast<unsigned char const*>(buffer) - base_);
+        }
+
+    }; // buffer_pool
+
+
+    // Readers get immutable snapshot without waiting, writers publish
+    // modified copy and recycle the previous one when no reader can see it.
+    // Readers are counted per epoch parity in per-thread slots
+    template<typename T, std::size_t Slots = 32>
+    class rcu_synchronized {
+
+        struct slot {
+            std::atomic<std::uint32_t> readers[2] {};
+        };
+
+        alignas(cacheline_size) std::atomic<T const*> current_ {nullptr};
+        std::atomic<std::uint32_t> epoch_ {0};
+        cache_aligned_array<slot, Slots> slots_;
+        spinlock writer_;
+        pool<T> snapshots_;
+        pool_pointer<T> published_;
+
+        slot& this_thread_slot() const noexcept {
+            return const_cast<slot&>(slots_[detail::this_thread_index() % Slots]);
+        }
+
+
+        // Flips twice, so readers of both parities that could see the
+        // previous snapshot have left while new ones don't block writer
+        void synchronize_readers() noexcept {
+            for(int i = 0; i != 2; ++i) {
+                auto const parity = epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+                for(auto& s: slots_)
+                    while(s.readers[parity].load(std::memory_order_seq_cst) != 0)
+                        relax();
+            }
+        }
+
+    public:
+
+        using resource_type = T;
+
+        struct shared_access {
+            shared_access() = delete;
+            shared_access(shared_access const&) = delete;
+            shared_access& operator=(shared_access const&) = delete;
+
+            shared_access(rcu_synchronized const& owner) noexcept {
+                auto const parity = owner.epoch_.load(std::memory_order_relaxed) & 1;
+                readers_ = &owner.this_thread_slot().readers[parity];
+                readers_->fetch_add(1, std::memory_order_seq_cst);
+                resource_ = owner.current_.load(std::memory_order_seq_cst);
+            }
+
+            ~shared_access() { readers_->fetch_sub(1, std::memory_order_release); }
+
+            T const& operator*() const noexcept { return *resource_; }
+            T const* operator->() const noexcept { return resource_; }
+            template<typename F> void run(F&& f) { f(*resource_); }
+
+        private:
+            std::atomic<std::uint32_t>* readers_;
+            T const* resource_;
+
+        };   // shared_access
+
+
+        template<typename... Args>
+        rcu_synchronized(Args&&... args): published_(snapshots_.remake()) {
+            *published_ = T(std::forward<Args>(args)...);
+            current_.store(&*published_, std::memory_order_release);
+        }
+
+        rcu_synchronized(rcu_synchronized const&) = delete;
+        rcu_synchronized& operator=(rcu_synchronized const&) = delete;
+
+
+        // Applies f to a copy of the current snapshot and publishes it,
+        // waits for readers of the previous snapshot; nothing is published
+        // if f throws
+        template<typename F> void update(F&& f) {
+            std::unique_lock<spinlock> guard {writer_};
+            auto next = snapshots_.remake();
+            try {
+                *next = *published_;
+                f(*next);
+            } catch(...) {
+                // nothing is published, snapshot goes back to the pool
+                snapshots_.recycle(next);
+                throw;
+            }
+            current_.store(&*next, std::memory_order_seq_cst);
+            synchronize_readers();
+            snapshots_.recycle(published_);
+            published_ = next;
+        }
+
+
+        void store(T value) {
+            update([&](T& resource) { resource = std::move(value); });
+        }
+
+    };   // rcu_synchronized
+
+
+    // Two instances of T: readers use the active one without waiting and
+    // register in per-thread read indicators of the current version, the
+    // writer changes passive instance, swaps them, waits for readers to
+    // leave the old one and repeats the change there. Operations on
+    // unique_access are applied twice, so they have to be deterministic
+    template<typename T, std::size_t Slots = 32>
+    class left_right {
+
+        struct slot {
+            std::atomic<std::uint32_t> readers[2] {};
+        };
+
+        alignas(cacheline_size) T left_;
+        alignas(cacheline_size) T right_;
+        alignas(cacheline_size) std::atomic<std::uint32_t> active_ {0};
+        std::atomic<std::uint32_t> version_ {0};
+        cache_aligned_array<slot, Slots> slots_;
+        spinlock writer_;
+
+        T& instance(std::uint32_t index) noexcept { return index == 0 ? left_ : right_; }
+
+        T const& instance(std::uint32_t index) const noexcept {
+            return index == 0 ? left_ : right_;
+        }
+
+        slot& this_thread_slot() const noexcept {
+            return const_cast<slot&>(slots_[detail::this_thread_index() % Slots]);
+        }
+
+
+        void wait_for_readers(std::uint32_t version) const noexcept {
+            for(auto const& s: slots_)
+                while(s.readers[version].load(std::memory_order_seq_cst) != 0)
+                    relax();
+        }
+
+
+        // Called with writer_ locked; if f throws, instances are copied
+        // from the one readers see, so they don't diverge
+        template<typename F> void apply(F& f) {
+            static_assert(std::is_copy_assignable_v<T> || std::is_nothrow_invocable_v<F&, T&>,
+                          "operation on not copy assignable resource has to be noexcept");
+
+            auto const active = active_.load(std::memory_order_relaxed);
+            apply_to(f, active ^ 1, active);
+            active_.store(active ^ 1, std::memory_order_seq_cst);
+
+            // arriving readers move to the other indicator, then late
+            // readers of the previous instance drain from both
+            auto const version = version_.load(std::memory_order_relaxed);
+            wait_for_readers(version ^ 1);
+            version_.store(version ^ 1, std::memory_order_seq_cst);
+            wait_for_readers(version);
+
+            apply_to(f, active, active ^ 1);
+        }
+
+
+        // Nobody reads instance(index) while f or recovery changes it
+        template<typename F> void apply_to(F& f, std::uint32_t index, std::uint32_t read) {
+            if constexpr(std::is_copy_assignable_v<T>) {
+                try {
+                    f(instance(index));
+                } catch(...) {
+                    instance(index) = instance(read);
+                    throw;
+                }
+            } else {
+                f(instance(index));
+            }
+        }
+
+    public:
+
+        using resource_type = T;
+
+        struct shared_access {
+            shared_access() = delete;
+            shared_access(shared_access const&) = delete;
+            shared_access& operator=(shared_access const&) = delete;
+
+            shared_access(left_right const& owner) noexcept {
+                auto const version = owner.version_.load(std::memory_order_seq_cst);
+                readers_ = &owner.this_thread_slot().readers[version];
+                readers_->fetch_add(1, std::memory_order_seq_cst);
+                resource_ = &owner.instance(owner.active_.load(std::memory_order_seq_cst));
+            }
+
+            ~shared_access() { readers_->fetch_sub(1, std::memory_order_release); }
+
+            T const& operator*() const noexcept { return *resource_; }
+            T const* operator->() const noexcept { return resource_; }
+            template<typename F> void run(F&& f) { f(*resource_); }
+
+        private:
+            std::atomic<std::uint32_t>* readers_;
+            T const* resource_;
+
+        };   // shared_access
+
+
+        // Excludes other writers; the resource is readable, changes go
+        // through run() to both instances
+        struct unique_access {
+            unique_access() = delete;
+            unique_access(unique_access const&) = delete;
+            unique_access& operator=(unique_access const&) = delete;
+
+            unique_access(left_right& owner) noexcept: guard_(owner.writer_), owner_(owner) {}
+
+            T const& operator*() const noexcept { return owner_.instance(active()); }
+            T const* operator->() const noexcept { return &owner_.instance(active()); }
+            template<typename F> void run(F&& f) { owner_.apply(f); }
+
+        private:
+            std::unique_lock<spinlock> guard_;
+            left_right& owner_;
+
+            std::uint32_t active() const noexcept {
+                return owner_.active_.load(std::memory_order_relaxed);
+            }
+
+        };   // unique_access
+
+
+        // Both instances are constructed from the same arguments
+        template<typename... Args>
+        left_right(Args const&... args): left_(args...), right_(args...) {}
+
+        left_right(left_right const&) = delete;
+        left_right& operator=(left_right const&) = delete;
+
+
+        template<typename F> void modify(F&& f) { unique_access {*this}.run(f); }
+
+    };   // left_right
+
+
+
+    // Bounded wait-free queue for one producer and one consumer thread,
+    // each side caches the index of the other one
+    template<typename T, std::size_t N> class spsc_queue {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity should be power of two");
+
+        struct cell {
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+
+        alignas(cacheline_size) std::atomic<std::size_t> tail_ {0};
+        std::size_t cached_head_ {0};
+        alignas(cacheline_size) std::atomic<std::size_t> head_ {0};
+        std::size_t cached_tail_ {0};
+        alignas(cacheline_size) cell cells_[N];
+
+        void* place(std::size_t index) noexcept {
+            return cells_[index & (N - 1)].bytes;
+        }
+
+        T& at(std::size_t index) noexcept {
+            return *std::launder(reinterpret_cast<T*>(place(index)));
+        }
+
+    public:
+
+        spsc_queue() noexcept = default;
+        spsc_queue(spsc_queue const&) = delete;
+        spsc_queue& operator = (spsc_queue const&) = delete;
+
+        ~spsc_queue() {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            for(auto head = head_.load(std::memory_order_relaxed); head != tail; ++head)
+                at(head).~T();
+        }
+
+        static constexpr std::size_t capacity() noexcept { return N; }
+
+        std::size_t size() const noexcept {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        bool empty() const noexcept { return size() == 0; }
+
+
+        // Producer side
+
+        template<typename... Args> bool try_emplace(Args&&... args) {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            if(tail - cached_head_ == N) {
+                cached_head_ = head_.load(std::memory_order_acquire);
+                if(tail - cached_head_ == N)
+                    return false;
+            }
+            new(place(tail)) T(std::forward<Args>(args)...);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+
+        bool try_push(T const& value) { return try_emplace(value); }
+        bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+
+        // Pushes up to n values, returns how many were pushed
+        template<typename It> std::size_t push_n(It first, std::size_t n) {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            if(N - (tail - cached_head_) < n)
+                cached_head_ = head_.load(std::memory_order_acquire);
+            auto const free = N - (tail - cached_head_);
+            auto const count = free < n ? free : n;
+            for(std::size_t i = 0; i != count; ++i, ++first)
+                new(place(tail + i)) T(*first);
+            tail_.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+
+        // Consumer side
+
+        bool try_pop(T& value) {
+            auto const head = head_.load(std::memory_order_relaxed);
+            if(head == cached_tail_) {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                if(head == cached_tail_)
+                    return false;
+            }
+            auto& stored = at(head);
+            value = std::move(stored);
+            stored.~T();
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+
+        // Pops up to n values, returns how many were popped
+        template<typename It> std::size_t pop_n(It out, std::size_t n) {
+            auto const head = head_.load(std::memory_order_relaxed);
+            if(cached_tail_ - head < n)
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+            auto const available = cached_tail_ - head;
+            auto const count = available < n ? available : n;
+            for(std::size_t i = 0; i != count; ++i, ++out) {
+                auto& stored = at(head + i);
+                *out = std::move(stored);
+                stored.~T();
+            }
+            head_.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+    }; // spsc_queue
+
+
+    // Bounded queue for many producers and consumers (D. Vyukov), every
+    // cell has its own sequence number; blocking push()/pop() wait through
+    // backoff policy B on the sequence of the cell they have to use
+    template<typename T, typename B = pause_yield_backoff<>> class mpmc_queue {
+
+        struct cell {
+            alignas(cacheline_size) std::atomic<std::uint32_t> sequence;
+            alignas(T) unsigned char bytes[sizeof(T)];
+
+            T& value() noexcept { return *std::launder(reinterpret_cast<T*>(bytes)); }
+        };
+
+        std::unique_ptr<cell[]> cells_;
+        std::uint32_t mask_;
+        alignas(cacheline_size) std::atomic<std::uint32_t> tail_ {0};
+        alignas(cacheline_size) std::atomic<std::uint32_t> head_ {0};
+
+        static std::uint32_t round_capacity(std::size_t capacity) noexcept {
+            std::uint32_t rounded = 2;
+            while(rounded < capacity && rounded < (std::uint32_t{1} << 31))
+                rounded *= 2;
+            return rounded;
+        }
+
+        static std::int32_t distance(std::uint32_t from, std::uint32_t to) noexcept {
+            return static_cast<std::int32_t>(to - from);
+        }
+
+    public:
+
+        // Capacity is rounded up to power of two
+        explicit mpmc_queue(std::size_t capacity)
+            : cells_(new cell[round_capacity(capacity)]),
+              mask_(round_capacity(capacity) - 1) {
+            for(std::uint32_t i = 0; i != mask_ + 1; ++i)
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        mpmc_queue(mpmc_queue const&) = delete;
+        mpmc_queue& operator = (mpmc_queue const&) = delete;
+
+        ~mpmc_queue() {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            for(auto head = head_.load(std::memory_order_relaxed); head != tail; ++head)
+                cells_[head & mask_].value().~T();
+        }
+
+        std::size_t capacity() const noexcept { return std::size_t(mask_) + 1; }
+
+
+        template<typename... Args> bool try_emplace(Args&&... args) {
+            auto position = tail_.load(std::memory_order_relaxed);
+            for(;;) {
+                auto& c = cells_[position & mask_];
+                auto const sequence = c.sequence.load(std::memory_order_acquire);
+                auto const d = distance(position, sequence);
+                if(d == 0) {
+                    if(tail_.compare_exchange_weak(position,
+                                                   position + 1,
+                                                   std::memory_order_relaxed)) {
+                        new(c.bytes) T(std::forward<Args>(args)...);
+                        c.sequence.store(position + 1, std::memory_order_release);
+                        B::wake_all(c.sequence);
+                        return true;
+                    }
+                } else if(d < 0) {
+                    return false;   // full
+                } else {
+                    position = tail_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+
+        bool try_push(T const& value) { return try_emplace(value); }
+        bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+
+        bool try_pop(T& value) {
+            auto position = head_.load(std::memory_order_relaxed);
+            for(;;) {
+                auto& c = cells_[position & mask_];
+                auto const sequence = c.sequence.load(std::memory_order_acquire);
+                auto const d = distance(position + 1, sequence);
+                if(d == 0) {
+                    if(head_.compare_exchange_weak(position,
+                                                   position + 1,
+                                                   std::memory_order_relaxed)) {
+                        value = std::move(c.value());
+                        c.value().~T();
+                        c.sequence.store(position + mask_ + 1, std::memory_order_release);
+                        B::wake_all(c.sequence);
+                        return true;
+                    }
+                } else if(d < 0) {
+                    return false;   // empty
+                } else {
+                    position = head_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+
+        template<typename... Args> void emplace(Args&&... args) {
+            B backoff;
+            while(!try_emplace(std::forward<Args>(args)...)) {
+                auto const position = tail_.load(std::memory_order_relaxed);
+                auto& c = cells_[position & mask_];
+                auto const sequence = c.sequence.load(std::memory_order_relaxed);
+                if(distance(position, sequence) < 0)
+                    backoff.wait(c.sequence, sequence);
+            }
+        }
+
+
+        void push(T const& value) { emplace(value); }
+        void push(T&& value) { emplace(std::move(value)); }
+
+
+        void pop(T& value) {
+            B backoff;
+            while(!try_pop(value)) {
+                auto const position = head_.load(std::memory_order_relaxed);
+                auto& c = cells_[position & mask_];
+                auto const sequence = c.sequence.load(std::memory_order_relaxed);
+                if(distance(position + 1, sequence) < 0)
+                    backoff.wait(c.sequence, sequence);
+            }
+        }
+
+    }; // mpmc_queue
+
+
+    namespace detail {
+
+
+        // Move-only void(T&) callable stored in place, e.g. in a queue cell,
+        // callables larger than Size don't compile instead of allocating
+        template<typename T, std::size_t Size> class inline_operation {
+
+            alignas(std::max_align_t) unsigned char storage_[Size];
+            void (*invoke_)(void*, T&) {nullptr};
+            // moves callable to second argument unless it's null, destroys it
+            void (*manage_)(void*, void*) noexcept {nullptr};
+
+        public:
+
+            inline_operation() noexcept = default;
+
+            template<typename F,
+                     typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, inline_operation>>>
+            inline_operation(F&& f) {
+                using callable = std::decay_t<F>;
+                static_assert(sizeof(callable) <= Size, "operation exceeds inline storage");
+                static_assert(alignof(callable) <= alignof(std::max_align_t));
+                static_assert(std::is_nothrow_move_constructible_v<callable>);
+
+                ::new(static_cast<void*>(storage_)) callable(std::forward<F>(f));
+                invoke_ = [](void* stored, T& resource) {
+                    (*static_cast<callable*>(stored))(resource);
+                };
+                manage_ = [](void* stored, void* to) noexcept {
+                    auto* const f = static_cast<callable*>(stored);
+                    if(to != nullptr)
+                        ::new(to) callable(std::move(*f));
+                    f->~callable();
+                };
+            }
+
+            inline_operation(inline_operation&& other) noexcept { take(other); }
+
+            inline_operation& operator = (inline_operation&& other) noexcept {
+                if(this != &other) {
+                    reset();
+                    take(other);
+                }
+                return *this;
+            }
+
+            ~inline_operation() { reset(); }
+
+            void operator()(T& resource) { invoke_(storage_, resource); }
+
+            explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+        private:
+
+            void take(inline_operation& other) noexcept {
+                if(other.manage_ == nullptr)
+                    return;
+                other.manage_(other.storage_, storage_);
+                invoke_ = std::exchange(other.invoke_, nullptr);
+                manage_ = std::exchange(other.manage_, nullptr);
+            }
+
+            void reset() noexcept {
+                if(manage_ == nullptr)
+                    return;
+                manage_(storage_, nullptr);
+                invoke_ = nullptr;
+                manage_ = nullptr;
+            }
+
+        }; // inline_operation
+
+
+    }   // namespace detail
+
+
+    // T that belongs to one owner thread, other threads don't lock it but
+    // send operations through mpmc_queue, the owner runs them in process();
+    // operations may be move-only and up to Size bytes, stored in the queue
+    template<typename T, typename B = pause_yield_backoff<>, std::size_t Size = 96> class owned {
+        // move-only, kept in the queue cell without allocation
+        using operation = detail::inline_operation<T, Size>;
+
+        alignas(cacheline_size) T resource_;
+        mpmc_queue<operation, B> operations_;
+
+    public:
+
+        using resource_type = T;
+
+        template<typename... Args>
+        explicit owned(std::size_t capacity, Args&&... args)
+            : resource_(std::forward<Args>(args)...), operations_(capacity) {}
+
+        owned(owned const&) = delete;
+        owned& operator = (owned const&) = delete;
+
+
+        // Fire and forget, waits while queue is full
+        template<typename F> void post(F&& f) {
+            operations_.emplace(std::forward<F>(f));
+        }
+
+
+        template<typename F> bool try_post(F&& f) {
+            return operations_.try_emplace(std::forward<F>(f));
+        }
+
+
+        // Owner thread sets result of f to the promise, which has to live
+        // until it's ready
+        template<typename R, std::size_t Spins, typename F>
+        void call(promise<R, Spins>& result, F&& f) {
+            post([&result, f = std::forward<F>(f)](T& resource) mutable {
+                result = f(resource);
+            });
+        }
+
+
+        // Owner thread only: runs posted operations and returns their number,
+        // exception of operation leaves the rest in queue
+        std::size_t process() {
+            operation next;
+            std::size_t processed = 0;
+            while(operations_.try_pop(next)) {
+                next(resource_);
+                ++processed;
+            }
+            return processed;
+        }
+
+
+        // Owner thread only: waits for operation and runs it
+        void process_one() {
+            operation next;
+            operations_.pop(next);
+            next(resource_);
+        }
+
+
+        // Owner thread only
+        T& resource() noexcept { return resource_; }
+
+    }; // owned
+
+
+    // Base of objects handed over by lockfree_stack and intrusive_mpsc_queue,
+    // e.g. pool objects; node is in one container at a time
+    struct intrusive_node {
+        std::atomic<intrusive_node*> next {nullptr};
+    };
+
+
+    // Treiber stack of intrusive nodes, 16-bit tag in unused high bits of
+    // the top pointer (32-bit tag on 32-bit platforms) defeats ABA. Popped
+    // nodes have to stay readable as long as the stack is used. With 5-level
+    // paging or tagged pointers (ARM TBI, Intel LAM) configure the bits that
+    // addresses use, e.g. -DUSYNC_POINTER_BITS=57
+    template<typename T> class lockfree_stack {
+
+        static_assert(std::is_base_of_v<intrusive_node, T>);
+
+#if defined(USYNC_POINTER_BITS)
+        static constexpr std::uint32_t pointer_bits = USYNC_POINTER_BITS;
+#else
+        static constexpr std::uint32_t pointer_bits = sizeof(void*) == 8 ? 48 : 32;
+#endif
+        static_assert(pointer_bits >= 32 && pointer_bits < 64, "no tag bits are left");
+        static constexpr std::uint64_t pointer_mask = (std::uint64_t{1} << pointer_bits) - 1;
+
+        alignas(cacheline_size) std::atomic<std::uint64_t> top_ {0};
+
+        static intrusive_node* node_of(std::uint64_t top) noexcept {
+            auto const address = static_cast<std::uintptr_t>(top & pointer_mask);
+            return reinterpret_cast<intrusive_node*>(address);
+        }
+
+        static std::uint64_t tagged(intrusive_node* node, std::uint64_t top) noexcept {
+            auto const tag = (top >> pointer_bits) + 1;
+            auto const address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+            // address bits above pointer_bits would be lost
+            assert((address & ~pointer_mask) == 0 && "see USYNC_POINTER_BITS");
+            return tag << pointer_bits | address;
+        }
+
+    public:
+
+        lockfree_stack() noexcept = default;
+        lockfree_stack(lockfree_stack const&) = delete;
+        lockfree_stack& operator = (lockfree_stack const&) = delete;
+
+
+        void push(T* value) noexcept {
+            intrusive_node* node = value;
+            auto top = top_.load(std::memory_order_relaxed);
+            for(;;) {
+                node->next.store(node_of(top), std::memory_order_relaxed);
+                if(top_.compare_exchange_weak(top,
+                                              tagged(node, top),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+
+        // nullptr when empty
+        T* pop() noexcept {
+            auto top = top_.load(std::memory_order_acquire);
+            for(;;) {
+                auto* node = node_of(top);
+                if(node == nullptr)
+                    return nullptr;
+                auto* next = node->next.load(std::memory_order_relaxed);
+                if(top_.compare_exchange_weak(top,
+                                              tagged(next, top),
+                                              std::memory_order_acquire,
+                                              std::memory_order_acquire))
+                    return static_cast<T*>(node);
+            }
+        }
+
+
+        // Takes all nodes at once and calls f(T&) for them from the top,
+        // returns their number
+        template<typename F> std::size_t drain_all(F&& f) {
+            auto top = top_.load(std::memory_order_relaxed);
+            while(!top_.compare_exchange_weak(top,
+                                              tagged(nullptr, top),
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed))
+                ;
+            std::size_t drained = 0;
+            for(auto* node = node_of(top); node != nullptr; ++drained) {
+                // f may recycle the node
+                auto* next = node->next.load(std::memory_order_relaxed);
+                f(*static_cast<T*>(node));
+                node = next;
+            }
+            return drained;
+        }
+
+
+        bool empty() const noexcept {
+            return node_of(top_.load(std::memory_order_relaxed)) == nullptr;
+        }
+
+    }; // lockfree_stack
+
+
+    // Unbounded queue of intrusive nodes for many producers and one
+    // consumer (D. Vyukov): push() is one exchange, pop() usually makes
+    // no atomic read-modify-write at all
+    template<typename T> class intrusive_mpsc_queue {
+
+        static_assert(std::is_base_of_v<intrusive_node, T>);
+
+        alignas(cacheline_size) std::atomic<intrusive_node*> head_;
+        alignas(cacheline_size) intrusive_node* tail_;
+        intrusive_node stub_;
+
+        void push_node(intrusive_node* node) noexcept {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            auto* previous = head_.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release);
+        }
+
+    public:
+
+        intrusive_mpsc_queue() noexcept: head_(&stub_), tail_(&stub_) {}
+        intrusive_mpsc_queue(intrusive_mpsc_queue const&) = delete;
+        intrusive_mpsc_queue& operator = (intrusive_mpsc_queue const&) = delete;
+
+
+        void push(T* value) noexcept { push_node(value); }
+
+
+        // Consumer only: nullptr when empty or when the last producer
+        // hasn't linked its node yet
+        T* pop() noexcept {
+            auto* tail = tail_;
+            auto* next = tail->next.load(std::memory_order_acquire);
+            if(tail == &stub_) {
+                if(next == nullptr)
+                    return nullptr;
+                tail_ = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+
+            if(next != nullptr) {
+                tail_ = next;
+                return static_cast<T*>(tail);
+            }
+
+            if(tail != head_.load(std::memory_order_acquire))
+                return nullptr;
+
+            // the last node is taken by putting stub behind it
+            push_node(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if(next == nullptr)
+                return nullptr;
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+
+
+        // Consumer only: calls f(T&) in FIFO order for nodes pushed before
+        // the call, waiting for their producers to link them, and returns
+        // their number; nodes pushed meanwhile, also by f, stay queued
+        template<typename F> std::size_t drain_all(F&& f) {
+            // stub_ as the last node means everything before it
+            auto* const last = head_.load(std::memory_order_acquire);
+            std::size_t drained = 0;
+            while(last != &stub_ || tail_ != &stub_) {
+                auto* const node = pop();
+                if(node == nullptr) {
+                    relax();
+                    continue;
+                }
+                ++drained;
+                f(*node);
+                if(node == last)
+                    break;
+            }
+            return drained;
+        }
 
+    }; // intrusive_mpsc_queue
 
 }   // namespace usync
@@ -1,9 +1,27 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
 #include <thread>
+#include <utility>
+#include <vector>
 #include <usync/usync.hpp>
 
+// <windows.h> that parks futex-based locks like adaptive_lock is included
+// without leaving its configuration macros to the includer
+#if defined(_WIN32) && (defined(WIN32_LEAN_AND_MEAN) || defined(NOMINMAX) || defined(min))
+#    error "usync.hpp leaks <windows.h> configuration"
+#endif
+
 class resource {
     int value_ {0};
 
@@ -70,6 +88,274 @@ TEST_CASE("shared_spinlock::shared_spinlock") {
 }
 
 
+TEST_CASE_TEMPLATE("basic_spinlock::backoff",
+                   B,
+                   usync::yield_backoff,
+                   usync::pause_backoff,
+                   usync::exponential_backoff<>,
+                   usync::pause_yield_backoff<>,
+                   usync::pause_park_backoff<>) {
+    resource r;
+    usync::basic_spinlock<B> guard;
+
+    auto t1 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            std::scoped_lock lock {guard};
+            r.turn_up();
+        }
+    });
+
+    auto t2 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            std::scoped_lock lock {guard};
+            r.turn_down();
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    REQUIRE_EQ(r.value(), 0);
+}
+
+
+TEST_CASE_TEMPLATE("basic_shared_spinlock::backoff",
+                   B,
+                   usync::yield_backoff,
+                   usync::exponential_backoff<>,
+                   usync::pause_park_backoff<>) {
+    resource r;
+    usync::basic_shared_spinlock<B> guard;
+
+    auto t1 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            std::unique_lock lock {guard};
+            r.turn_up();
+        }
+    });
+
+    auto t2 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to read
+            std::shared_lock lock {guard};
+            REQUIRE_GE(r.value(), 0);
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    std::shared_lock lock {guard};
+    REQUIRE_EQ(r.value(), 1000);
+}
+
+
+TEST_CASE_TEMPLATE(
+    "distributed shared locks",
+    L,
+    usync::distributed_shared_spinlock<>,
+    usync::distributed_shared_spinlock<4, usync::rw_preference::readers>,
+    usync::asymmetric_shared_lock<>,
+    usync::asymmetric_shared_lock<1>) {
+    resource r;
+    L guard;
+
+    auto writer = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            std::unique_lock lock {guard};
+            r.turn_up();
+            r.turn_up();
+        }
+    });
+
+    auto read = [&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to read
+            std::shared_lock lock {guard};
+            REQUIRE_EQ(r.value() % 2, 0);
+        }
+    };
+
+    auto reader1 = std::thread(read);
+    auto reader2 = std::thread(read);
+
+    writer.join();
+    reader1.join();
+    reader2.join();
+
+    std::shared_lock lock {guard};
+    REQUIRE_EQ(r.value(), 2000);
+}
+
+
+TEST_CASE_TEMPLATE("exclusive locks",
+                   L,
+                   usync::ticket_lock,
+                   usync::mcs_lock,
+                   usync::adaptive_lock,
+                   usync::compact_spinlock,
+                   usync::padded<usync::ticket_lock>,
+                   usync::cohort_lock,
+                   usync::basic_cohort_lock<1, 2>,
+                   usync::elided_lock<>,
+                   usync::elided_lock<usync::ticket_lock>) {
+    using synchronized = usync::synchronized<resource, L>;
+
+    synchronized resource;
+
+    auto t1 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            typename synchronized::unique_access r {resource};
+            r->turn_up();
+        }
+    });
+
+    auto t2 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            typename synchronized::unique_access r {resource};
+            r->turn_down();
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    // access to read
+    typename synchronized::shared_access r {resource};
+    REQUIRE_EQ(r->value(), 0);
+}
+
+
+TEST_CASE("synchronized layout") {
+    // resource starts on the line next to the lock
+    static_assert(sizeof(usync::synchronized<int, usync::spinlock>) == 2 * usync::cacheline_size);
+    static_assert(sizeof(usync::synchronized<int, usync::padded<std::mutex>>)
+                  >= usync::cacheline_size + sizeof(int));
+    static_assert(alignof(usync::padded<std::mutex>) == usync::cacheline_size);
+    // lock and resource share one line
+    static_assert(sizeof(usync::synchronized<int, usync::compact_spinlock>) == 2 * sizeof(int));
+}
+
+
+TEST_CASE("cache_aligned_array") {
+    static_assert(alignof(usync::cache_padded<char>) == usync::padding_size);
+    static_assert(sizeof(usync::cache_padded<char>) == usync::padding_size);
+
+    usync::cache_aligned_array<int, 4> slots;
+    REQUIRE_EQ(slots[3], 0);
+    REQUIRE_EQ(reinterpret_cast<char*>(&slots[1]) - reinterpret_cast<char*>(&slots[0]),
+               usync::padding_size);
+
+    int n = 0;
+    for(auto& slot: slots)
+        slot = ++n;
+    REQUIRE_EQ(std::as_const(slots)[2], 3);
+}
+
+
+TEST_CASE("adaptive_lock") {
+    resource r;
+    usync::adaptive_lock guard;
+
+    // more threads than cores make waiters park
+    std::thread threads[8];
+    for(auto& t: threads)
+        t = std::thread([&]() {
+            for(int i = 0; i != 1000; ++i) {
+                std::scoped_lock lock {guard};
+                r.turn_up();
+                std::this_thread::yield();
+                r.turn_down();
+            }
+        });
+    for(auto& t: threads)
+        t.join();
+
+    REQUIRE_EQ(r.value(), 0);
+    REQUIRE(guard.try_lock());
+    REQUIRE_FALSE(guard.try_lock());
+    guard.unlock();
+}
+
+
+TEST_CASE("mcs_lock::try_lock") {
+    usync::mcs_lock first;
+    usync::mcs_lock second;
+
+    REQUIRE(first.try_lock());
+    REQUIRE_FALSE(first.try_lock());
+    second.lock();
+
+    // unlocking out of order gives nodes back to the thread
+    first.unlock();
+    REQUIRE(first.try_lock());
+    second.unlock();
+    first.unlock();
+}
+
+
+TEST_CASE("instrumented") {
+    using synchronized = usync::synchronized<resource, usync::instrumented<usync::spinlock>>;
+
+    synchronized resource;
+
+    auto t1 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            synchronized::unique_access r {resource};
+            r->turn_up();
+        }
+    });
+
+    auto t2 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to read
+            synchronized::shared_access r {resource};
+            REQUIRE_GE(r->value(), 0);
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    auto const counted = resource.policy().snapshot();
+    REQUIRE_EQ(counted.acquisitions, 1000);
+    REQUIRE_EQ(counted.shared_acquisitions, 1000);
+
+    usync::instrumented<usync::spinlock> lock;
+    REQUIRE(lock.try_lock());
+    REQUIRE_FALSE(lock.try_lock());
+    lock.unlock();
+
+    auto const statistics = lock.snapshot();
+    REQUIRE_EQ(statistics.acquisitions, 1);
+    REQUIRE_EQ(statistics.failed_try_locks, 1);
+    REQUIRE_EQ(statistics.contentions, 0);
+
+    // shared holds of different locks are timed per lock
+    usync::instrumented<usync::spinlock> first;
+    usync::instrumented<usync::spinlock> second;
+    first.lock_shared();
+    second.lock_shared();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    first.unlock_shared();
+    second.unlock_shared();
+    REQUIRE_GE(first.snapshot().hold_ns, 20'000'000);
+    REQUIRE_GE(second.snapshot().hold_ns, 20'000'000);
+
+    usync::instrumented<usync::spinlock, false> disabled;
+    disabled.lock();
+    disabled.unlock();
+    REQUIRE_EQ(disabled.snapshot().acquisitions, 0);
+}
+
+
 TEST_CASE("synchronized") {
     using synchronized = usync::synchronized<resource>;
 
@@ -98,3 +384,903 @@ TEST_CASE("synchronized") {
     synchronized::shared_access r {resource};
     REQUIRE_EQ(r->value(), 0);
 }
+
+
+TEST_CASE("synchronized::upgradable_access") {
+    using synchronized = usync::synchronized<resource, usync::shared_spinlock>;
+
+    synchronized resource;
+
+    auto upgrader = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // check then modify
+            synchronized::upgradable_access r {resource};
+            if(r->value() % 2 == 0)
+                r.upgrade().turn_up();
+        }
+    });
+
+    auto writer = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to modify
+            synchronized::unique_access r {resource};
+            if(r->value() % 2 != 0)
+                r->turn_up();
+        }
+    });
+
+    auto reader = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to read
+            synchronized::shared_access r {resource};
+            REQUIRE_GE(r->value(), 0);
+        }
+    });
+
+    upgrader.join();
+    writer.join();
+    reader.join();
+
+    usync::shared_spinlock lock;
+    lock.lock_upgrade();
+    REQUIRE_FALSE(lock.try_lock());
+    REQUIRE_FALSE(lock.try_lock_upgrade());
+    REQUIRE(lock.try_lock_shared());
+    REQUIRE_FALSE(lock.try_upgrade());
+    lock.unlock_shared();
+    REQUIRE(lock.try_upgrade());
+    REQUIRE_FALSE(lock.try_lock_shared());
+    lock.unlock();
+    REQUIRE(lock.try_lock());
+    lock.unlock();
+}
+
+TEST_CASE("synchronize") {
+    using synchronized = usync::synchronized<resource>;
+    using shared = usync::synchronized<resource, usync::shared_spinlock>;
+
+    synchronized account;
+    synchronized position;
+    shared limits;
+
+    auto t1 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            auto [a, p, l] = usync::synchronize(account, position, std::as_const(limits));
+            a->turn_up();
+            p->turn_down();
+            REQUIRE_EQ(l->value(), 0);
+        }
+    });
+
+    auto t2 = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // opposite order doesn't deadlock
+            auto [p, a] = usync::synchronize(position, account);
+            p->turn_up();
+            a->turn_down();
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    // repeated resource is rejected before anything is locked
+    REQUIRE_THROWS_AS(usync::synchronize(account, position, account), std::invalid_argument);
+    REQUIRE_THROWS_AS(usync::synchronize(std::as_const(limits), limits), std::invalid_argument);
+
+    auto [a, p] = usync::synchronize(std::as_const(account), std::as_const(position));
+    REQUIRE_EQ(a->value(), 0);
+    REQUIRE_EQ(p->value(), 0);
+}
+
+TEST_CASE_TEMPLATE("timed lock",
+                   L,
+                   usync::no_lock,
+                   usync::spinlock,
+                   usync::shared_spinlock,
+                   usync::distributed_shared_spinlock<>,
+                   usync::asymmetric_shared_lock<>,
+                   usync::ticket_lock,
+                   usync::mcs_lock,
+                   usync::cohort_lock,
+                   usync::adaptive_lock,
+                   usync::seqlock,
+                   usync::elided_lock<>,
+                   usync::instrumented<usync::spinlock>,
+                   std::shared_timed_mutex) {
+    using namespace std::chrono_literals;
+    using synchronized = usync::synchronized<resource, L>;
+    synchronized shared;
+
+    {
+        auto r = shared.try_unique_access(1ms);
+        REQUIRE(r.has_value());
+        (*r)->turn_up();
+
+        if constexpr(!std::is_same_v<L, usync::no_lock>) {
+            // owner stalls, others give up in time
+            auto const started = std::chrono::steady_clock::now();
+            bool acquired = true;
+            std::thread([&]() {
+                acquired = shared.try_unique_access(2ms).has_value()
+                        || std::as_const(shared).try_shared_access(2ms).has_value();
+            }).join();
+            REQUIRE_FALSE(acquired);
+            REQUIRE_GE(std::chrono::steady_clock::now() - started, 2ms);
+        }
+    }
+
+    auto r = std::as_const(shared).try_shared_access(1ms);
+    REQUIRE(r.has_value());
+    REQUIRE_EQ((*r)->value(), 1);
+}
+
+
+TEST_CASE("shared_spinlock::try_lock_for") {
+    using namespace std::chrono_literals;
+    usync::shared_spinlock lock;
+
+    // reader stalls the writer, which gives the flag back on timeout
+    REQUIRE(lock.try_lock_shared_for(1ms));
+    REQUIRE_FALSE(lock.try_lock_for(1ms));
+    REQUIRE(lock.try_lock_shared_for(1ms));
+    lock.unlock_shared();
+    lock.unlock_shared();
+    REQUIRE(lock.try_lock_for(1ms));
+    lock.unlock();
+}
+
+
+TEST_CASE("elided_lock") {
+    // no retries: always taken in fallback, inside transaction of the other
+    usync::elided_lock<> elided;
+    usync::elided_lock<usync::spinlock, 0> fallback;
+
+    for(int i = 0; i != 100; ++i) {
+        elided.lock();
+        fallback.lock();
+        REQUIRE(fallback.is_locked());
+        if(i % 2 == 0) {
+            fallback.unlock();
+            elided.unlock();
+        } else {
+            elided.unlock();
+            fallback.unlock();
+        }
+        REQUIRE_FALSE(elided.is_locked());
+        REQUIRE_FALSE(fallback.is_locked());
+    }
+
+    std::thread([&]() {
+        REQUIRE(fallback.try_lock());
+        fallback.unlock();
+        REQUIRE(elided.try_lock());
+        elided.unlock();
+    }).join();
+}
+
+
+TEST_CASE("synchronized::submit") {
+    using synchronized = usync::synchronized<resource, usync::flat_combining<>>;
+    synchronized shared;
+
+    std::thread threads[4];
+    for(auto& t: threads)
+        t = std::thread([&]() {
+            for(int i = 0; i != 1000; ++i) {
+                shared.submit([](resource& r) { r.turn_up(); });
+                // regular access excludes combiners
+                synchronized::unique_access r {shared};
+                r->turn_down();
+                r->turn_up();
+            }
+        });
+    for(auto& t: threads)
+        t.join();
+
+    int seen = 0;
+    shared.submit([&](resource const& r) { seen = r.value(); });
+    REQUIRE_EQ(seen, 4000);
+    REQUIRE_THROWS_AS(shared.submit([](resource&) { throw std::runtime_error {"failed"}; }),
+                      std::runtime_error);
+
+    // other policies just lock
+    usync::synchronized<resource> plain;
+    plain.submit([](resource& r) { r.turn_up(); });
+    REQUIRE_EQ(usync::synchronized<resource>::shared_access {plain}->value(), 1);
+}
+
+
+TEST_CASE("synchronized::optimistic_access") {
+    struct quote {
+        int bid;
+        int ask;
+    };
+
+    using synchronized = usync::synchronized<quote, usync::seqlock>;
+
+    synchronized resource {quote {0, 0}};
+
+    auto writer = std::thread([&]() {
+        for(int i = 1; i != 1001; ++i) {
+            // access to modify
+            synchronized::unique_access r {resource};
+            r->bid = i;
+            r->ask = i;
+        }
+    });
+
+    auto reader = std::thread([&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // access to snapshot
+            synchronized::optimistic_access r {resource};
+            REQUIRE_EQ(r->bid, r->ask);
+        }
+    });
+
+    writer.join();
+    reader.join();
+
+    synchronized::optimistic_access r {resource};
+    REQUIRE_EQ(r->bid, 1000);
+}
+
+
+TEST_CASE("sharded") {
+    using counters = usync::sharded<long, usync::spinlock, 8>;
+    counters hits;
+
+    auto count = [&](int id) {
+        for(int i = 0; i != 1000; ++i) {
+            ++*hits.local_access();
+            ++*hits.thread_access();
+            ++*hits.access(id * 1000 + i);
+        }
+    };
+
+    auto t1 = std::thread(count, 1);
+    auto t2 = std::thread(count, 2);
+    t1.join();
+    t2.join();
+
+    auto const total = hits.reduce(0l, [](long sum, long shard) { return sum + shard; });
+    REQUIRE_EQ(total, 6000);
+
+    std::size_t visited = 0;
+    hits.for_each_shard([&](long) { ++visited; });
+    REQUIRE_EQ(visited, counters::shard_count);
+
+    *hits.access(42) += 100;
+    REQUIRE_GE(*hits.shared(42), 100);
+}
+
+
+TEST_CASE("owned") {
+    usync::owned<resource> counter {64};
+    std::atomic<bool> stopped {false};
+
+    auto owner = std::thread([&]() {
+        while(!stopped.load(std::memory_order_acquire))
+            counter.process();
+        counter.process();
+    });
+
+    auto send = [&]() {
+        for(int i = 0; i != 1000; ++i)
+            counter.post([](resource& r) { r.turn_up(); });
+    };
+
+    auto t1 = std::thread(send);
+    auto t2 = std::thread(send);
+    t1.join();
+    t2.join();
+
+    // move-only operation
+    auto steps = std::make_unique<int>(3);
+    counter.post([steps = std::move(steps)](resource& r) {
+        for(int i = 0; i != *steps; ++i)
+            r.turn_up();
+    });
+
+    usync::promise<int> value;
+    counter.call(value, [](resource& r) { return r.value(); });
+    REQUIRE_EQ(value.await(), 2003);
+
+    stopped.store(true, std::memory_order_release);
+    owner.join();
+    REQUIRE_EQ(counter.resource().value(), 2003);
+}
+
+
+TEST_CASE("left_right") {
+    using book = std::vector<int>;
+    using left_right = usync::left_right<book>;
+
+    left_right levels {book(1000, 0)};
+
+    auto writer = std::thread([&]() {
+        for(int i = 1; i != 201; ++i) {
+            left_right::unique_access w {levels};
+            w.run([&](book& b) { b.front() = i; b.back() = i; });
+            REQUIRE_EQ(w->front(), i);
+        }
+    });
+
+    auto read = [&]() {
+        for(int i = 0; i != 1000; ++i) {
+            left_right::shared_access r {levels};
+            REQUIRE_EQ(r->front(), r->back());
+        }
+    };
+
+    auto reader1 = std::thread(read);
+    auto reader2 = std::thread(read);
+
+    writer.join();
+    reader1.join();
+    reader2.join();
+
+    levels.modify([](book& b) { b.push_back(7); });
+
+    // partial change of throwing operation is rolled back
+    auto const rejected = [](book& b) {
+        b.push_back(8);
+        throw std::runtime_error("rejected");
+    };
+    REQUIRE_THROWS_AS(levels.modify(rejected), std::runtime_error);
+    levels.modify([](book& b) { ++b.back(); });
+
+    left_right::shared_access r {levels};
+    REQUIRE_EQ(r->size(), 1001);
+    REQUIRE_EQ(r->front(), 200);
+    REQUIRE_EQ(r->back(), 8);
+}
+
+
+TEST_CASE("pool") {
+    usync::pool<std::vector<int>> pool;
+
+    auto p = pool.remake();
+    p->push_back(1);
+    pool.recycle(p);
+
+    // recycled object keeps its state
+    auto q = pool.remake();
+    REQUIRE_EQ(q->size(), 1);
+    REQUIRE_EQ(&*q, &*p);
+}
+
+
+TEST_CASE("pool_magazine") {
+    usync::synchronized_pool<resource> shared;
+
+    auto work = [&]() {
+        usync::pool_magazine<resource> magazine {shared, 8, 4, 4};
+        usync::pool_pointer<resource> taken[6];
+        for(int i = 0; i != 1000; ++i) {
+            for(auto& p: taken) {
+                p = magazine.remake();
+                p->turn_up();
+            }
+            for(auto& p: taken) {
+                p->turn_down();
+                magazine.recycle(p);
+            }
+            REQUIRE_LE(magazine.size(), 8);
+        }
+    };
+
+    auto t1 = std::thread(work);
+    auto t2 = std::thread(work);
+    t1.join();
+    t2.join();
+
+    usync::synchronized_pool<resource>::unique_access pool {shared};
+    auto p = pool->remake();
+    REQUIRE_EQ(p->value(), 0);
+    pool->recycle(p);
+}
+
+TEST_CASE("lockfree_pool") {
+    usync::lockfree_pool<resource> pool {4};
+
+    auto work = [&]() {
+        for(int i = 0; i != 1000; ++i) {
+            auto p = pool.remake();
+            REQUIRE(p);
+            p->turn_up();
+            p->turn_down();
+            pool.recycle(p);
+        }
+    };
+
+    auto t1 = std::thread(work);
+    auto t2 = std::thread(work);
+    t1.join();
+    t2.join();
+
+    usync::lockfree_pool_pointer<resource> taken[4];
+    for(auto& p: taken) {
+        p = pool.remake();
+        REQUIRE(p);
+        REQUIRE_EQ(p->value(), 0);
+    }
+    REQUIRE_FALSE(pool.remake());
+    for(auto& p: taken)
+        pool.recycle(p);
+}
+
+
+TEST_CASE("lockfree_pool_magazine") {
+    usync::lockfree_pool<resource> shared {16};
+
+    auto work = [&]() {
+        usync::lockfree_pool_magazine<resource> magazine {shared, 4, 2, 2};
+        usync::lockfree_pool_pointer<resource> taken[3];
+        for(int i = 0; i != 1000; ++i) {
+            for(auto& p: taken) {
+                p = magazine.remake();
+                REQUIRE(p);
+                p->turn_up();
+            }
+            for(auto& p: taken) {
+                p->turn_down();
+                magazine.recycle(p);
+            }
+            REQUIRE_LE(magazine.size(), 4);
+        }
+    };
+
+    auto t1 = std::thread(work);
+    auto t2 = std::thread(work);
+    t1.join();
+    t2.join();
+
+    usync::lockfree_pool_magazine<resource> magazine {shared, 32, 32, 32};
+    std::vector<usync::lockfree_pool_pointer<resource>> taken;
+    for(int i = 0; i != 16; ++i) {
+        taken.push_back(magazine.remake());
+        REQUIRE(taken.back());
+        REQUIRE_EQ(taken.back()->value(), 0);
+    }
+    REQUIRE_FALSE(magazine.remake());
+    for(auto& p: taken)
+        magazine.recycle(p);
+}
+
+
+TEST_CASE("arena_pool") {
+    using arena = usync::arena_pool<std::pair<int, int>, 100>;
+    arena orders;
+
+    auto const first = orders.remake(1, 2);
+    REQUIRE(first);
+    REQUIRE_EQ(orders.get(first)->second, 2);
+    static_assert(sizeof(arena::handle) == 4);
+
+    arena::handle burst[100];
+    REQUIRE_EQ(orders.remake_n(burst, 100), 99);
+    REQUIRE_FALSE(orders.remake());
+    REQUIRE_EQ(orders.size(), arena::capacity());
+
+    orders.recycle(first);
+    orders.recycle_n(burst, 49);
+    REQUIRE_EQ(orders.size(), 50);
+    // slot is reused, but the old handle stays stale
+    auto const second = orders.remake(3, 4);
+    REQUIRE_NE(second, first);
+    REQUIRE_EQ(orders.get(first), nullptr);
+    orders.recycle(first);
+    REQUIRE_EQ(orders.size(), 51);
+
+    // stale and repeated handles are skipped in batch
+    arena::handle const twice[] = {burst[60], burst[60]};
+    orders.recycle_n(twice, 2);
+    orders.recycle_n(burst, 49);
+    REQUIRE_EQ(orders.size(), 50);
+    REQUIRE_EQ(orders.get(burst[60]), nullptr);
+
+    std::size_t live = 0;
+    orders.for_each([&](arena::handle h, std::pair<int, int>& order) {
+        REQUIRE_EQ(orders.get(h), &order);
+        ++live;
+    });
+    REQUIRE_EQ(live, 50);
+}
+
+
+TEST_CASE("buffer_pool") {
+    // stands for shared memory segment mapped twice
+    alignas(usync::cacheline_size) static unsigned char region[64 * 1024];
+
+    auto producer = usync::buffer_pool::create(region, sizeof(region), 1000);
+    REQUIRE(producer);
+    REQUIRE_EQ(producer.buffer_size() % usync::cacheline_size, 0);
+    REQUIRE_FALSE(usync::buffer_pool::create(region + 1, sizeof(region) - 1, 1000));
+
+    auto consumer = usync::buffer_pool::attach(region);
+    REQUIRE(consumer);
+    REQUIRE_EQ(consumer.capacity(), producer.capacity());
+
+    std::vector<usync::buffer_pool::offset> taken;
+    std::thread threads[2];
+    for(auto& t: threads)
+        t = std::thread([&]() {
+            for(int i = 0; i != 1000; ++i) {
+                auto const buffer = producer.remake();
+                REQUIRE_NE(buffer, 0);
+                std::memset(producer.data(buffer), i, producer.buffer_size());
+                consumer.recycle(buffer);
+            }
+        });
+    for(auto& t: threads)
+        t.join();
+
+    for(auto b = consumer.remake(); b != 0; b = consumer.remake())
+        taken.push_back(b);
+    REQUIRE_EQ(taken.size(), consumer.capacity());
+    REQUIRE_EQ(consumer.offset_of(consumer.data(taken.back())), taken.back());
+}
+
+
+TEST_CASE("spsc_queue") {
+    usync::spsc_queue<int, 64> queue;
+
+    auto producer = std::thread([&]() {
+        int next = 0;
+        while(next != 10000) {
+            if(next % 2 == 0) {
+                int batch[8];
+                auto const n = std::min(8, 10000 - next);
+                for(int i = 0; i != n; ++i)
+                    batch[i] = next + i;
+                next += int(queue.push_n(batch, std::size_t(n)));
+            } else if(queue.try_push(next)) {
+                ++next;
+            }
+        }
+    });
+
+    int expected = 0;
+    while(expected != 10000) {
+        int batch[16];
+        auto const n = queue.pop_n(batch, 16);
+        for(std::size_t i = 0; i != n; ++i)
+            REQUIRE_EQ(batch[i], expected++);
+        int value;
+        if(queue.try_pop(value))
+            REQUIRE_EQ(value, expected++);
+    }
+
+    producer.join();
+    REQUIRE(queue.empty());
+}
+
+
+TEST_CASE_TEMPLATE("mpmc_queue",
+                   B,
+                   usync::pause_yield_backoff<>,
+                   usync::pause_park_backoff<>) {
+    usync::mpmc_queue<std::unique_ptr<int>, B> queue {10};
+    REQUIRE_EQ(queue.capacity(), 16);
+
+    auto produce = [&]() {
+        for(int i = 1; i != 1001; ++i)
+            queue.push(std::make_unique<int>(i));
+    };
+
+    std::atomic<long> sum {0};
+    auto consume = [&]() {
+        for(int i = 0; i != 1000; ++i) {
+            std::unique_ptr<int> value;
+            queue.pop(value);
+            sum += *value;
+        }
+    };
+
+    auto p1 = std::thread(produce);
+    auto p2 = std::thread(produce);
+    auto c1 = std::thread(consume);
+    auto c2 = std::thread(consume);
+    p1.join();
+    p2.join();
+    c1.join();
+    c2.join();
+
+    REQUIRE_EQ(sum.load(), 2 * 500500);
+    std::unique_ptr<int> value;
+    REQUIRE_FALSE(queue.try_pop(value));
+    REQUIRE(queue.try_push(std::make_unique<int>(1)));
+}
+
+
+TEST_CASE("promise") {
+    usync::promise<int> result;
+
+    REQUIRE_EQ(result.try_get(), nullptr);
+    REQUIRE_EQ(result.await_for(std::chrono::milliseconds {1}), nullptr);
+
+    auto t = std::thread([&]() { result = 42; });
+
+    REQUIRE_EQ(result.await(), 42);
+    t.join();
+
+    REQUIRE_NE(result.try_get(), nullptr);
+    REQUIRE_EQ(*result.await_for(std::chrono::seconds {1}), 42);
+
+    result.clear();
+    REQUIRE_FALSE(result.ready());
+}
+
+
+TEST_CASE("broadcast_promise") {
+    usync::broadcast_promise<int> snapshot;
+    usync::latch done {3};
+    std::atomic<int> sum {0};
+
+    auto consume = [&]() {
+        sum += snapshot.await();
+        done.count_down();
+    };
+
+    auto t1 = std::thread(consume);
+    auto t2 = std::thread(consume);
+    auto t3 = std::thread(consume);
+
+    snapshot = 7;
+    done.wait();
+    REQUIRE_EQ(sum.load(), 21);
+    REQUIRE_EQ(snapshot.generation(), 1);
+
+    t1.join();
+    t2.join();
+    t3.join();
+
+    auto const seen = snapshot.generation();
+    REQUIRE_EQ(snapshot.await_next_for(seen, std::chrono::milliseconds {1}), nullptr);
+    snapshot = 8;
+    REQUIRE_EQ(snapshot.await_next(seen), 8);
+}
+
+
+TEST_CASE("barrier") {
+    usync::barrier phase {3};
+    std::atomic<int> arrived {0};
+
+    auto work = [&]() {
+        for(int i = 1; i != 101; ++i) {
+            ++arrived;
+            phase.arrive_and_wait();
+            REQUIRE_GE(arrived.load(), 3 * i);
+            phase.arrive_and_wait();
+        }
+    };
+
+    auto t1 = std::thread(work);
+    auto t2 = std::thread(work);
+    work();
+    t1.join();
+    t2.join();
+
+    REQUIRE_EQ(arrived.load(), 300);
+}
+
+
+TEST_CASE("rcu_synchronized") {
+    using routes = std::vector<int>;
+    using rcu = usync::rcu_synchronized<routes>;
+
+    rcu table {routes {0, 0}};
+
+    auto writer = std::thread([&]() {
+        for(int i = 1; i != 501; ++i)
+            table.update([&](routes& r) {
+                r[0] = i;
+                r[1] = -i;
+            });
+    });
+
+    auto read = [&]() {
+        for(int i = 0; i != 1000; ++i) {
+            // snapshot stays intact while it's read
+            rcu::shared_access r {table};
+            REQUIRE_EQ((*r)[0], -(*r)[1]);
+        }
+    };
+
+    auto reader1 = std::thread(read);
+    auto reader2 = std::thread(read);
+
+    writer.join();
+    reader1.join();
+    reader2.join();
+
+    table.store(routes {7});
+    rcu::shared_access r {table};
+    REQUIRE_EQ(r->size(), 1);
+    REQUIRE_EQ(r->front(), 7);
+}
+
+
+struct counted {
+    static inline int instances = 0;
+    int value {0};
+
+    counted() noexcept { ++instances; }
+    counted(counted const& other) noexcept: value(other.value) { ++instances; }
+    counted& operator = (counted const&) = default;
+    ~counted() { --instances; }
+};
+
+
+TEST_CASE("rcu_synchronized::update throws") {
+    usync::rcu_synchronized<counted> shared;
+    shared.update([](counted& c) { c.value = 1; });
+    auto const instances = counted::instances;
+
+    for(int i = 0; i != 100; ++i)
+        REQUIRE_THROWS_AS(shared.update([](counted& c) {
+            c.value = -1;
+            throw std::runtime_error("rejected");
+        }), std::runtime_error);
+
+    // failed updates neither publish nor keep their snapshots
+    REQUIRE_EQ(counted::instances, instances);
+    usync::rcu_synchronized<counted>::shared_access r {shared};
+    REQUIRE_EQ(r->value, 1);
+}
+
+
+struct message: usync::intrusive_node {
+    int producer {0};
+    int sequence {0};
+};
+
+
+TEST_CASE("lockfree_stack") {
+    static message messages[1000];
+    usync::lockfree_stack<message> stack;
+    for(auto& m: messages)
+        stack.push(&m);
+
+    // nodes go back and forth between threads
+    auto churn = [&]() {
+        for(int i = 0; i != 10000; ++i)
+            if(auto* m = stack.pop())
+                stack.push(m);
+    };
+    auto t1 = std::thread(churn);
+    auto t2 = std::thread(churn);
+    t1.join();
+    t2.join();
+
+    REQUIRE_EQ(stack.drain_all([](message&) {}), 1000);
+    REQUIRE(stack.empty());
+    REQUIRE_EQ(stack.pop(), nullptr);
+}
+
+
+TEST_CASE("intrusive_mpsc_queue") {
+    static message messages[2][1000];
+    usync::intrusive_mpsc_queue<message> queue;
+
+    auto produce = [&](int producer) {
+        for(int i = 0; i != 1000; ++i) {
+            auto& m = messages[producer][i];
+            m.producer = producer;
+            m.sequence = i;
+            queue.push(&m);
+        }
+    };
+    auto t1 = std::thread(produce, 0);
+    auto t2 = std::thread(produce, 1);
+
+    int expected[2] = {0, 0};
+    std::size_t received = 0;
+    while(received != 2000)
+        received += queue.drain_all([&](message& m) {
+            // FIFO for every producer
+            REQUIRE_EQ(m.sequence, expected[m.producer]++);
+        });
+
+    t1.join();
+    t2.join();
+    REQUIRE_EQ(queue.pop(), nullptr);
+
+    // nodes pushed by f are left for the next drain
+    for(auto& m: messages[0])
+        queue.push(&m);
+    REQUIRE_EQ(queue.drain_all([&](message& m) { queue.push(&m); }), 1000);
+    REQUIRE_EQ(queue.drain_all([](message&) {}), 1000);
+    REQUIRE_EQ(queue.drain_all([](message&) {}), 0);
+}
+
+
+#if defined(USYNC_HAS_COROUTINES)
+
+// Starts eagerly and destroys itself at the end
+struct task {
+    struct promise_type {
+        task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+
+TEST_CASE("async_lock") {
+    using synchronized = usync::synchronized<resource, usync::async_lock>;
+    synchronized shared;
+    std::vector<int> order;
+    std::vector<std::coroutine_handle<>> scheduled;
+    auto executor = [&](std::coroutine_handle<> h) { scheduled.push_back(h); };
+
+    auto worker = [&](int id) -> task {
+        auto r = co_await shared.unique_async();
+        r->turn_up();
+        order.push_back(id);
+    };
+
+    auto scheduled_worker = [&](int id) -> task {
+        auto r = co_await shared.unique_async(executor);
+        r->turn_up();
+        order.push_back(id);
+    };
+
+    {
+        synchronized::unique_access held {shared};
+        worker(1);
+        worker(2);
+        scheduled_worker(3);
+        worker(4);
+        REQUIRE(order.empty());
+    }
+
+    // ownership passes in arrival order, executor gets its coroutine
+    REQUIRE_EQ(order, std::vector<int> {1, 2});
+    REQUIRE_EQ(scheduled.size(), 1);
+    scheduled.front().resume();
+    REQUIRE_EQ(order, std::vector<int> {1, 2, 3, 4});
+
+    worker(5);
+    REQUIRE_EQ(synchronized::shared_access {shared}->value(), 5);
+}
+
+
+TEST_CASE("async_promise") {
+    usync::async_promise<int> answer;
+    int first = 0;
+    int second = 0;
+
+    auto waiter = [&](int& got) -> task { got = co_await answer; };
+    waiter(first);
+    waiter(second);
+    REQUIRE_EQ(first, 0);
+
+    answer = 42;
+    REQUIRE_EQ(first, 42);
+    REQUIRE_EQ(second, 42);
+
+    // ready value doesn't suspend
+    int third = 0;
+    waiter(third);
+    REQUIRE_EQ(third, 42);
+
+    // setting again keeps the promise ready
+    answer = 43;
+    REQUIRE(answer.ready());
+    REQUIRE_EQ(*answer.try_get(), 43);
+
+    answer.clear();
+    int fourth = 0;
+    waiter(fourth);
+    REQUIRE_EQ(fourth, 0);
+    answer = 1;
+    answer = 2;
+    REQUIRE_EQ(fourth, 1);
+    REQUIRE_EQ(*answer.try_get(), 2);
+}
+
+#endif